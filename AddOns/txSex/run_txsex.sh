@@ -7,9 +7,14 @@
 # Set up the environment
 mmPath=$(cat /dev/shm/.mmPath)
 . $mmPath/MockbaMod/env.sh
-port="$(cat $mmPath/AddOns/txSex/TX-MIDI-PORT.txt)"
-if test "$1" == "kill"; then
+action="$1"
+# One output port name per line in TX-MIDI-PORT.txt
+set --
+while IFS= read -r port || [ -n "$port" ]; do
+  [ -n "$port" ] && set -- "$@" -p "$port"
+done < $mmPath/AddOns/txSex/TX-MIDI-PORT.txt
+if test "$action" == "kill"; then
     killall txsex 2>/dev/null
 else
-  $mmPath/AddOns/txSex/txsex -p "$port"  2>/dev/null   &
+  $mmPath/AddOns/txSex/txsex "$@"  2>/dev/null   &
 fi
@@ -38,6 +38,7 @@
 /**********************************************************************/
 
 #include "RtMidi.h"
+#include <cstring>
 #include <sstream>
 
 #if defined(__MACOSX_CORE__)
@@ -57,7 +58,7 @@
 //
 // **************************************************************** //
 
-#if !defined(__LINUX_ALSA__) && !defined(__UNIX_JACK__) && !defined(__MACOSX_CORE__) && !defined(__WINDOWS_MM__)
+#if !defined(__LINUX_ALSA__) && !defined(__UNIX_JACK__) && !defined(__MACOSX_CORE__) && !defined(__WINDOWS_MM__) && !defined(__RTMIDI_LOOPBACK__)
   #define __RTMIDI_DUMMY__
 #endif
 
@@ -183,6 +184,7 @@ class MidiOutAlsa: public MidiOutApi
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
   void sendMessage( const unsigned char *message, size_t size );
+  void sendAfter( const unsigned char *message, size_t size, double delay );
 
  protected:
   void initialize( const std::string& clientName );
@@ -270,6 +272,55 @@ class MidiOutDummy: public MidiOutApi
 
 #endif
 
+#if defined(__RTMIDI_LOOPBACK__)
+
+struct LoopbackPort;
+
+class MidiInLoopback: public MidiInApi
+{
+ public:
+  MidiInLoopback( const std::string &clientName, unsigned int queueSizeLimit );
+  ~MidiInLoopback( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::RTMIDI_LOOPBACK; }
+  void openPort( unsigned int portNumber, const std::string &portName );
+  void openVirtualPort( const std::string &portName );
+  void closePort( void );
+  void setClientName( const std::string &/*clientName*/ ) {};
+  void setPortName( const std::string &/*portName*/ ) {};
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+  void deliver( const unsigned char *message, size_t size );
+
+ protected:
+  void initialize( const std::string& clientName );
+  LoopbackPort *port_;
+  bool owner_;
+  double lastTime_;
+};
+
+class MidiOutLoopback: public MidiOutApi
+{
+ public:
+  MidiOutLoopback( const std::string &clientName );
+  ~MidiOutLoopback( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::RTMIDI_LOOPBACK; }
+  void openPort( unsigned int portNumber, const std::string &portName );
+  void openVirtualPort( const std::string &portName );
+  void closePort( void );
+  void setClientName( const std::string &/*clientName*/ ) {};
+  void setPortName( const std::string &/*portName*/ ) {};
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+  void sendMessage( const unsigned char *message, size_t size );
+
+ protected:
+  void initialize( const std::string& clientName );
+  LoopbackPort *port_;
+  bool owner_;
+};
+
+#endif
+
 //*********************************************************************//
 //  RtMidi Definitions
 //*********************************************************************//
@@ -300,6 +351,7 @@ const char* rtmidi_api_names[][2] = {
   { "jack"        , "Jack" },
   { "winmm"       , "Windows MultiMedia" },
   { "dummy"       , "Dummy" },
+  { "loopback"    , "Loopback" },
 };
 const unsigned int rtmidi_num_api_names =
   sizeof(rtmidi_api_names)/sizeof(rtmidi_api_names[0]);
@@ -307,6 +359,9 @@ const unsigned int rtmidi_num_api_names =
 // The order here will control the order of RtMidi's API search in
 // the constructor.
 extern "C" const RtMidi::Api rtmidi_compiled_apis[] = {
+#if defined(__RTMIDI_LOOPBACK__)
+  RtMidi::RTMIDI_LOOPBACK,
+#endif
 #if defined(__MACOSX_CORE__)
   RtMidi::MACOSX_CORE,
 #endif
@@ -405,6 +460,10 @@ void RtMidiIn :: openMidiApi( RtMidi::Api api, const std::string &clientName, un
   if ( api == RTMIDI_DUMMY )
     rtapi_ = new MidiInDummy( clientName, queueSizeLimit );
 #endif
+#if defined(__RTMIDI_LOOPBACK__)
+  if ( api == RTMIDI_LOOPBACK )
+    rtapi_ = new MidiInLoopback( clientName, queueSizeLimit );
+#endif
 }
 
 RTMIDI_DLL_PUBLIC RtMidiIn :: RtMidiIn( RtMidi::Api api, const std::string &clientName, unsigned int queueSizeLimit )
@@ -473,6 +532,10 @@ void RtMidiOut :: openMidiApi( RtMidi::Api api, const std::string &clientName )
   if ( api == RTMIDI_DUMMY )
     rtapi_ = new MidiOutDummy( clientName );
 #endif
+#if defined(__RTMIDI_LOOPBACK__)
+  if ( api == RTMIDI_LOOPBACK )
+    rtapi_ = new MidiOutLoopback( clientName );
+#endif
 }
 
 RTMIDI_DLL_PUBLIC RtMidiOut :: RtMidiOut( RtMidi::Api api, const std::string &clientName)
@@ -562,19 +625,30 @@ void MidiApi :: error( RtMidiError::Type type, std::string errorString )
 //  Common MidiInApi Definitions
 //*********************************************************************//
 
+// Bytes of sysex the queue of an input can hold, see QueuedMessage.
+static const unsigned int QUEUE_POOL_SIZE = 65536;
+
 MidiInApi :: MidiInApi( unsigned int queueSizeLimit )
   : MidiApi()
 {
-  // Allocate the MIDI queue.
+  inputData_.api = this;
+
+  // Allocate the MIDI queue and the pool its sysex messages go to.
   inputData_.queue.ringSize = queueSizeLimit;
-  if ( inputData_.queue.ringSize > 0 )
-    inputData_.queue.ring = new MidiMessage[ inputData_.queue.ringSize ];
+  if ( inputData_.queue.ringSize > 0 ) {
+    inputData_.queue.ring = new QueuedMessage[ inputData_.queue.ringSize ];
+    inputData_.queue.poolSize = QUEUE_POOL_SIZE;
+    inputData_.queue.pool = new unsigned char[ QUEUE_POOL_SIZE ];
+  }
 }
 
 MidiInApi :: ~MidiInApi( void )
 {
   // Delete the MIDI queue.
-  if ( inputData_.queue.ringSize > 0 ) delete [] inputData_.queue.ring;
+  if ( inputData_.queue.ringSize > 0 ) {
+    delete [] inputData_.queue.ring;
+    delete [] inputData_.queue.pool;
+  }
 }
 
 void MidiInApi :: setCallback( RtMidiIn::RtMidiCallback callback, void *userData )
@@ -596,6 +670,69 @@ void MidiInApi :: setCallback( RtMidiIn::RtMidiCallback callback, void *userData
   inputData_.usingCallback = true;
 }
 
+// Stands in for the user callback of a span callback on the APIs that
+// only deliver a vector.
+static void spanAdapter( double timeStamp, std::vector<unsigned char> *message, void *userData )
+{
+  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (userData);
+  RtMidiIn::MessageInfo info = { timeStamp, 0, 0, -1, -1 };
+  data->spanCallback( message->data(), message->size(), info, data->spanUserData );
+}
+
+void MidiInApi :: setSpanCallback( RtMidiIn::RtMidiSpanCallback callback, void *userData )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setSpanCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setSpanCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.spanCallback = callback;
+  inputData_.spanUserData = userData;
+  inputData_.userCallback = spanAdapter;
+  inputData_.userData = &inputData_;
+  inputData_.usingCallback = true;
+}
+
+// Stands in for the span callback of a batch callback on the APIs that
+// deliver one message at a time.
+static void batchAdapter( const unsigned char *message, size_t size,
+                          const RtMidiIn::MessageInfo &info, void *userData )
+{
+  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (userData);
+  RtMidiIn::BatchMessage one = { message, size, info };
+  data->batchCallback( &one, 1, data->batchUserData );
+}
+
+void MidiInApi :: setBatchCallback( RtMidiIn::RtMidiBatchCallback callback, void *userData )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setBatchCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setBatchCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.batchCallback = callback;
+  inputData_.batchUserData = userData;
+  inputData_.spanCallback = batchAdapter;
+  inputData_.spanUserData = &inputData_;
+  inputData_.userCallback = spanAdapter;
+  inputData_.userData = &inputData_;
+  inputData_.usingCallback = true;
+}
+
 void MidiInApi :: cancelCallback()
 {
   if ( !inputData_.usingCallback ) {
@@ -606,6 +743,10 @@ void MidiInApi :: cancelCallback()
 
   inputData_.userCallback = 0;
   inputData_.userData = 0;
+  inputData_.spanCallback = 0;
+  inputData_.spanUserData = 0;
+  inputData_.batchCallback = 0;
+  inputData_.batchUserData = 0;
   inputData_.usingCallback = false;
 }
 
@@ -661,14 +802,34 @@ bool MidiInApi::MidiQueue::push( const MidiInApi::MidiMessage& msg )
   // Get back/front indexes exactly once and calculate current size
   _size = size( &_back, &_front );
 
-  if ( _size < ringSize-1 )
-  {
-    ring[_back] = msg;
-    back = (back+1)%ringSize;
-    return true;
-  }
+  if ( _size >= ringSize-1 )
+    return false;
 
-  return false;
+  QueuedMessage &queued = ring[_back];
+  unsigned int n = msg.bytes.size();
+  if ( n <= sizeof( queued.data ) ) {
+    memcpy( queued.data, msg.bytes.data(), n );
+  }
+  else {
+    // The pool is a ring too, but a message is never split: when it
+    // does not fit before the end it goes to the start. pop() frees
+    // up to the end of the message it takes, so poolFront is read
+    // once, like front above.
+    unsigned int _poolFront = poolFront, offset = poolBack;
+    if ( offset >= _poolFront && poolSize - offset < n ) {
+      offset = 0; // what is free is [0, poolFront)
+      if ( _poolFront <= n ) return false;
+    }
+    else if ( offset < _poolFront && _poolFront - offset <= n )
+      return false;
+    memcpy( &pool[offset], msg.bytes.data(), n );
+    queued.offset = offset;
+    poolBack = offset + n;
+  }
+  queued.size = n;
+  queued.timeStamp = msg.timeStamp;
+  back = (back+1)%ringSize;
+  return true;
 }
 
 bool MidiInApi::MidiQueue::pop( std::vector<unsigned char> *msg, double* timeStamp )
@@ -683,8 +844,15 @@ bool MidiInApi::MidiQueue::pop( std::vector<unsigned char> *msg, double* timeSta
     return false;
 
   // Copy queued message to the vector pointer argument and then "pop" it.
-  msg->assign( ring[_front].bytes.begin(), ring[_front].bytes.end() );
-  *timeStamp = ring[_front].timeStamp;
+  const QueuedMessage &queued = ring[_front];
+  if ( queued.size <= sizeof( queued.data ) ) {
+    msg->assign( queued.data, queued.data + queued.size );
+  }
+  else {
+    msg->assign( &pool[queued.offset], &pool[queued.offset] + queued.size );
+    poolFront = queued.offset + queued.size;
+  }
+  *timeStamp = queued.timeStamp;
 
   // Update front
   front = (front+1)%ringSize;
@@ -1472,16 +1640,25 @@ void MidiOutCore :: sendMessage( const unsigned char *message, size_t size )
 // preprocessor definition AVOID_TIMESTAMPING to save resources
 // associated with the ALSA sequencer queues.
 
+#include <algorithm>
+#include <map>
+#include <set>
 #include <pthread.h>
 #include <sys/time.h>
 
 // ALSA header file.
 #include <alsa/asoundlib.h>
 
+// What an input collects for its batch callback before handing it
+// over, see alsaBatchAdd(): messages, and the bytes they are copied to.
+static const unsigned int ALSA_BATCH_SIZE = 64;
+static const unsigned int ALSA_BATCH_BYTES = 1024;
+
 // A structure to hold variables related to the ALSA API
 // implementation.
 struct AlsaMidiData {
   snd_seq_t *seq;
+  bool shared; // seq is the shared client, see RtMidiAlsaClient
   unsigned int portNum;
   int vport;
   snd_seq_port_subscribe_t *subscription;
@@ -1493,47 +1670,328 @@ struct AlsaMidiData {
   snd_seq_real_time_t lastTime;
   int queue_id; // an input queue is needed to get timestamped events
   int trigger_fds[2];
+  bool continueSysex;             // input: a sysex split in chunks is
+  MidiInApi::MidiMessage message; // being put back together here
+  std::vector<AlsaMidiData *> routes; // input: outputs forwarded to, and
+  std::vector<bool> forward;          // the event types, by ev->type
+  RtMidiIn::BatchMessage batch[ALSA_BATCH_SIZE]; // input: decoded, not yet
+  unsigned char batchBytes[ALSA_BATCH_BYTES];    // given to batchCallback
+  unsigned int batchCount, batchUsed;
+  RtMidiAlsaClient::ForwardCallback forwardCallback; // output: told what
+  void *forwardUserData;                             // was forwarded to it
 };
 
 #define PORT_TYPE( pinfo, bits ) ((snd_seq_port_info_get_capability(pinfo) & (bits)) == (bits))
 
+// The client every port uses after RtMidiAlsaClient::share(). Outputs
+// send from different threads, so they take outputLock around the
+// client's output buffer. The reader thread decodes under inputsLock,
+// so an input that is gone from 'inputs' is never touched again.
+struct AlsaSharedClient {
+  bool enabled = false;
+  std::string name;
+  snd_seq_t *seq = 0;
+  int users = 0;
+  int queue_id = -1;
+  pthread_mutex_t clientLock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_t inputsLock = PTHREAD_MUTEX_INITIALIZER;
+  std::map<int, MidiInApi::RtMidiInData *> inputs; // by our port number
+  std::set<AlsaMidiData *> routed; // inputs with routes, see route()
+  bool reading = false;
+  pthread_t thread;
+  int trigger_fds[2] = { -1, -1 };
+};
+static AlsaSharedClient alsaShared;
+
 //*********************************************************************//
 //  API: LINUX ALSA
 //  Class Definitions: MidiInAlsa
 //*********************************************************************//
 
-static void *alsaMidiHandler( void *ptr )
+// Sets up the decoder of an input.
+static bool alsaInputStart( MidiInApi::RtMidiInData *data )
 {
-  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
   AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
-
-  long nBytes;
-  double time;
-  bool continueSysex = false;
-  bool doDecode = false;
-  MidiInApi::MidiMessage message;
-  int poll_fd_count;
-  struct pollfd *poll_fds;
-
-  snd_seq_event_t *ev;
-  int result;
-  apiData->bufferSize = 32;
-  result = snd_midi_event_new( 0, &apiData->coder );
+  // Room for a whole sysex chunk (see alsaMidiDecode) and a message of
+  // a few chunks, so decoding does not allocate once running.
+  apiData->bufferSize = 256;
+  apiData->continueSysex = false;
+  apiData->message.bytes.reserve( 1024 );
+  apiData->batchCount = 0;
+  apiData->batchUsed = 0;
+  int result = snd_midi_event_new( 0, &apiData->coder );
   if ( result < 0 ) {
     data->doInput = false;
-    std::cerr << "\nMidiInAlsa::alsaMidiHandler: error initializing MIDI event parser!\n\n";
-    return 0;
+    data->api->error( RtMidiError::WARNING, "MidiInAlsa::alsaMidiHandler: error initializing MIDI event parser!" );
+    return false;
   }
-  unsigned char *buffer = (unsigned char *) malloc( apiData->bufferSize );
-  if ( buffer == NULL ) {
+  apiData->buffer = (unsigned char *) malloc( apiData->bufferSize );
+  if ( apiData->buffer == NULL ) {
     data->doInput = false;
     snd_midi_event_free( apiData->coder );
     apiData->coder = 0;
-    std::cerr << "\nMidiInAlsa::alsaMidiHandler: error initializing buffer memory!\n\n";
-    return 0;
+    data->api->error( RtMidiError::WARNING, "MidiInAlsa::alsaMidiHandler: error initializing buffer memory!" );
+    return false;
   }
   snd_midi_event_init( apiData->coder );
   snd_midi_event_no_status( apiData->coder, 1 ); // suppress running status messages
+  return true;
+}
+
+static void alsaInputStop( MidiInApi::RtMidiInData *data )
+{
+  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+  if ( apiData->buffer ) free( apiData->buffer );
+  apiData->buffer = 0;
+  if ( apiData->coder ) snd_midi_event_free( apiData->coder );
+  apiData->coder = 0;
+}
+
+// Hands what an input collected over to its batch callback.
+static void alsaBatchFlush( MidiInApi::RtMidiInData *data )
+{
+  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+  if ( apiData->batchCount == 0 ) return;
+  data->batchCallback( apiData->batch, apiData->batchCount, data->batchUserData );
+  apiData->batchCount = 0;
+  apiData->batchUsed = 0;
+}
+
+// Adds a message to the batch of an input, flushing first when it is
+// full. A message longer than the batch's bytes goes out on its own.
+static void alsaBatchAdd( MidiInApi::RtMidiInData *data, const unsigned char *bytes, size_t size,
+                          const RtMidiIn::MessageInfo &info )
+{
+  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+  if ( apiData->batchCount == ALSA_BATCH_SIZE || size > ALSA_BATCH_BYTES - apiData->batchUsed )
+    alsaBatchFlush( data );
+  RtMidiIn::BatchMessage &m = apiData->batch[apiData->batchCount++];
+  m.size = size;
+  m.info = info;
+  if ( size <= ALSA_BATCH_BYTES ) {
+    memcpy( &apiData->batchBytes[apiData->batchUsed], bytes, size );
+    m.message = &apiData->batchBytes[apiData->batchUsed];
+    apiData->batchUsed += size;
+  }
+  else {
+    m.message = bytes;
+    alsaBatchFlush( data );
+  }
+}
+
+// Decodes one event of an input and delivers the message once complete.
+// With a batch callback, the caller flushes once it has read all it can.
+static void alsaMidiDecode( MidiInApi::RtMidiInData *data, snd_seq_event_t *ev )
+{
+  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+  MidiInApi::MidiMessage &message = apiData->message;
+  bool &continueSysex = apiData->continueSysex;
+  bool doDecode = false;
+  long nBytes;
+  double time;
+  const unsigned char *bytes = 0; // the complete message, if any
+  size_t size = 0;
+
+  // This is a bit weird, but we now have to decode an ALSA MIDI
+  // event (back) into MIDI bytes.  We'll ignore non-MIDI types.
+  if ( !continueSysex ) message.bytes.clear();
+
+  switch ( ev->type ) {
+
+  case SND_SEQ_EVENT_PORT_SUBSCRIBED:
+#if defined(__RTMIDI_DEBUG__)
+    std::cout << "MidiInAlsa::alsaMidiHandler: port connection made!\n";
+#endif
+    break;
+
+  case SND_SEQ_EVENT_PORT_UNSUBSCRIBED:
+    {
+      std::ostringstream ost;
+      ost << "MidiInAlsa::alsaMidiHandler: port connection has closed! sender = "
+          << (int) ev->data.connect.sender.client << ":" << (int) ev->data.connect.sender.port
+          << ", dest = " << (int) ev->data.connect.dest.client << ":"
+          << (int) ev->data.connect.dest.port;
+      data->api->error( RtMidiError::DEBUG_WARNING, ost.str() );
+    }
+    break;
+
+  case SND_SEQ_EVENT_QFRAME: // MIDI time code
+    if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
+    break;
+
+  case SND_SEQ_EVENT_TICK: // 0xF9 ... MIDI timing tick
+    if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
+    break;
+
+  case SND_SEQ_EVENT_CLOCK: // 0xF8 ... MIDI timing (clock) tick
+    if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
+    break;
+
+  case SND_SEQ_EVENT_SENSING: // Active sensing
+    if ( !( data->ignoreFlags & 0x04 ) ) doDecode = true;
+    break;
+
+  case SND_SEQ_EVENT_SYSEX:
+    if ( (data->ignoreFlags & 0x01) ) break;
+    if ( ev->data.ext.len > apiData->bufferSize ) {
+      apiData->bufferSize = ev->data.ext.len;
+      free( apiData->buffer );
+      apiData->buffer = (unsigned char *) malloc( apiData->bufferSize );
+      if ( apiData->buffer == NULL ) {
+        data->doInput = false;
+        data->api->error( RtMidiError::WARNING, "MidiInAlsa::alsaMidiHandler: error resizing buffer memory!" );
+        break;
+      }
+    }
+    doDecode = true;
+    break;
+
+  default:
+    doDecode = true;
+  }
+
+  if ( doDecode ) {
+
+    nBytes = snd_midi_event_decode( apiData->coder, apiData->buffer, apiData->bufferSize, ev );
+    if ( nBytes > 0 ) {
+      // The ALSA sequencer has a maximum buffer size for MIDI sysex
+      // events of 256 bytes.  If a device sends sysex messages larger
+      // than this, they are segmented into 256 byte chunks.  So,
+      // we'll watch for this and concatenate sysex chunks into a
+      // single sysex message if necessary. A span callback gets any
+      // other message straight from the decode buffer.
+      bool chunked = continueSysex;
+      continueSysex = ( ( ev->type == SND_SEQ_EVENT_SYSEX ) && ( apiData->buffer[nBytes-1] != 0xF7 ) );
+      if ( chunked || continueSysex || !data->spanCallback ) {
+        if ( !chunked )
+          message.bytes.assign( apiData->buffer, &apiData->buffer[nBytes] );
+        else
+          message.bytes.insert( message.bytes.end(), apiData->buffer, &apiData->buffer[nBytes] );
+        bytes = message.bytes.data();
+        size = message.bytes.size();
+      }
+      else {
+        bytes = apiData->buffer;
+        size = nBytes;
+      }
+
+      if ( !continueSysex ) {
+
+        // Calculate the time stamp:
+        message.timeStamp = 0.0;
+
+        // Method 1: Use the system time.
+        //(void)gettimeofday(&tv, (struct timezone *)NULL);
+        //time = (tv.tv_sec * 1000000) + tv.tv_usec;
+
+        // Method 2: Use the ALSA sequencer event time data.
+        // (thanks to Pedro Lopez-Cabanillas!).
+
+        // Using method from:
+        // https://www.gnu.org/software/libc/manual/html_node/Elapsed-Time.html
+
+        // Perform the carry for the later subtraction by updating y.
+        // Temp var y is timespec because computation requires signed types,
+        // while snd_seq_real_time_t has unsigned types.
+        snd_seq_real_time_t &x( ev->time.time );
+        struct timespec y;
+        y.tv_nsec = apiData->lastTime.tv_nsec;
+        y.tv_sec = apiData->lastTime.tv_sec;
+        if ( x.tv_nsec < (unsigned int)y.tv_nsec ) {
+            int nsec = (y.tv_nsec - (int)x.tv_nsec) / 1000000000 + 1;
+            y.tv_nsec -= 1000000000 * nsec;
+            y.tv_sec += nsec;
+        }
+        if ( x.tv_nsec - y.tv_nsec > 1000000000 ) {
+            int nsec = ((int)x.tv_nsec - y.tv_nsec) / 1000000000;
+            y.tv_nsec += 1000000000 * nsec;
+            y.tv_sec -= nsec;
+        }
+
+        // Compute the time difference.
+        time = (int)x.tv_sec - y.tv_sec + ((int)x.tv_nsec - y.tv_nsec)*1e-9;
+
+        apiData->lastTime = ev->time.time;
+
+        if ( data->firstMessage == true )
+          data->firstMessage = false;
+        else
+          message.timeStamp = time;
+      }
+      else
+        data->api->error( RtMidiError::DEBUG_WARNING, "MidiInAlsa::alsaMidiHandler: event parsing error or not a MIDI event!" );
+    }
+  }
+
+  if ( size == 0 || continueSysex ) return;
+
+  if ( data->spanCallback ) {
+    RtMidiIn::MessageInfo info = { message.timeStamp, ev->time.time.tv_sec, ev->time.time.tv_nsec,
+                                   ev->source.client, ev->source.port };
+    if ( data->batchCallback )
+      alsaBatchAdd( data, bytes, size, info );
+    else
+      data->spanCallback( bytes, size, info, data->spanUserData );
+  }
+  else if ( data->usingCallback ) {
+    RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
+    callback( message.timeStamp, &message.bytes, data->userData );
+  }
+  else {
+    // As long as we haven't reached our queue size limit, push the message.
+    if ( !data->queue.push( message ) )
+      data->api->error( RtMidiError::WARNING, "MidiInAlsa: message queue limit reached!!" );
+  }
+}
+
+// Waits for events, false when woken up with none (or to stop).
+static bool alsaMidiWait( snd_seq_t *seq, struct pollfd *poll_fds, int poll_fd_count )
+{
+  if ( snd_seq_event_input_pending( seq, 1 ) > 0 ) return true;
+
+  // No data pending
+  if ( poll( poll_fds, poll_fd_count, -1) >= 0 ) {
+    if ( poll_fds[0].revents & POLLIN ) {
+      bool dummy;
+      int res = read( poll_fds[0].fd, &dummy, sizeof(dummy) );
+      (void) res;
+    }
+  }
+  return false;
+}
+
+// Reads the next pending event without blocking, 0 when there is none.
+// A read error is reported through the error() of 'data', if given.
+static snd_seq_event_t *alsaMidiRead( snd_seq_t *seq, MidiInApi::RtMidiInData *data )
+{
+  snd_seq_event_t *ev;
+  if ( snd_seq_event_input_pending( seq, 1 ) <= 0 ) return 0;
+
+  // If here, there should be data.
+  int result = snd_seq_event_input( seq, &ev );
+  if ( result == -ENOSPC ) {
+    if ( data )
+      data->api->error( RtMidiError::WARNING, "MidiInAlsa::alsaMidiHandler: MIDI input buffer overrun!" );
+    return 0;
+  }
+  else if ( result <= 0 ) {
+    std::string text = "MidiInAlsa::alsaMidiHandler: unknown MIDI input error! System reports: ";
+    if ( data ) data->api->error( RtMidiError::WARNING, text + snd_strerror( result ) );
+    return 0;
+  }
+  return ev;
+}
+
+static void *alsaMidiHandler( void *ptr )
+{
+  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
+  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+
+  int poll_fd_count;
+  struct pollfd *poll_fds;
+
+  if ( !alsaInputStart( data ) ) return 0;
 
   poll_fd_count = snd_seq_poll_descriptors_count( apiData->seq, POLLIN ) + 1;
   poll_fds = (struct pollfd*)alloca( poll_fd_count * sizeof( struct pollfd ));
@@ -1541,176 +1999,303 @@ static void *alsaMidiHandler( void *ptr )
   poll_fds[0].fd = apiData->trigger_fds[0];
   poll_fds[0].events = POLLIN;
 
+  // Everything pending is read before the batch is flushed, so a burst
+  // is delivered in as few calls as the batch allows.
   while ( data->doInput ) {
+    if ( !alsaMidiWait( apiData->seq, poll_fds, poll_fd_count ) ) continue;
+    snd_seq_event_t *ev;
+    while ( data->doInput && ( ev = alsaMidiRead( apiData->seq, data ) ) ) {
+      alsaMidiDecode( data, ev );
+      snd_seq_free_event( ev );
+    }
+    if ( data->batchCallback ) alsaBatchFlush( data );
+  }
 
-    if ( snd_seq_event_input_pending( apiData->seq, 1 ) == 0 ) {
-      // No data pending
-      if ( poll( poll_fds, poll_fd_count, -1) >= 0 ) {
-        if ( poll_fds[0].revents & POLLIN ) {
-          bool dummy;
-          int res = read( poll_fds[0].fd, &dummy, sizeof(dummy) );
-          (void) res;
-        }
+  alsaInputStop( data );
+  apiData->thread = apiData->dummy_thread_id;
+  return 0;
+}
+
+// Re-sends an event from each output an input is routed to, as is.
+// Outputs with a forward callback are then told what they sent, decoded
+// with the input's coder (this thread's, and stateless for channel
+// messages).
+static void alsaForward( AlsaMidiData *apiData, snd_seq_event_t *ev )
+{
+  bool tell = false;
+  pthread_mutex_lock( &alsaShared.outputLock );
+  for ( size_t i = 0; i < apiData->routes.size(); i++ ) {
+    if ( apiData->routes[i]->vport < 0 ) continue;
+    snd_seq_ev_set_source( ev, apiData->routes[i]->vport );
+    snd_seq_ev_set_subs( ev );
+    snd_seq_ev_set_direct( ev );
+    snd_seq_event_output_direct( alsaShared.seq, ev );
+    tell |= apiData->routes[i]->forwardCallback != 0;
+  }
+  pthread_mutex_unlock( &alsaShared.outputLock );
+  if ( !tell || !apiData->coder ) return;
+
+  unsigned char message[12]; // an (N)RPN is the longest, four CCs
+  long size = snd_midi_event_decode( apiData->coder, message, sizeof( message ), ev );
+  if ( size <= 0 ) return;
+  for ( size_t i = 0; i < apiData->routes.size(); i++ ) {
+    AlsaMidiData *to = apiData->routes[i];
+    if ( to->vport >= 0 && to->forwardCallback )
+      to->forwardCallback( message, (size_t) size, to->forwardUserData );
+  }
+}
+
+// The reader of the shared client. Events go to the input that owns
+// the port they were sent to, or straight out when it is routed.
+static void *alsaSharedHandler( void * )
+{
+  AlsaSharedClient &S = alsaShared;
+  int poll_fd_count = snd_seq_poll_descriptors_count( S.seq, POLLIN ) + 1;
+  struct pollfd *poll_fds = (struct pollfd*)alloca( poll_fd_count * sizeof( struct pollfd ));
+  snd_seq_poll_descriptors( S.seq, poll_fds + 1, poll_fd_count - 1, POLLIN );
+  poll_fds[0].fd = S.trigger_fds[0];
+  poll_fds[0].events = POLLIN;
+
+  // As in alsaMidiHandler(), all that is pending is read, then each
+  // input's batch is flushed.
+  std::map<int, MidiInApi::RtMidiInData *>::iterator it;
+  while ( S.reading ) {
+    if ( !alsaMidiWait( S.seq, poll_fds, poll_fd_count ) ) continue;
+    pthread_mutex_lock( &S.inputsLock );
+    snd_seq_event_t *ev;
+    // Read errors are the client's, reported once through its first input
+    MidiInApi::RtMidiInData *report = S.inputs.empty() ? 0 : S.inputs.begin()->second;
+    while ( S.reading && ( ev = alsaMidiRead( S.seq, report ) ) ) {
+      it = S.inputs.find( ev->dest.port );
+      if ( it != S.inputs.end() && it->second->doInput ) {
+        AlsaMidiData *apiData = static_cast<AlsaMidiData *> (it->second->apiData);
+        if ( !apiData->routes.empty() && apiData->forward[ev->type] )
+          alsaForward( apiData, ev );
+        else
+          alsaMidiDecode( it->second, ev );
       }
-      continue;
+      snd_seq_free_event( ev );
     }
+    for ( it = S.inputs.begin(); it != S.inputs.end(); ++it )
+      if ( it->second->batchCallback ) alsaBatchFlush( it->second );
+    pthread_mutex_unlock( &S.inputsLock );
+  }
+  return 0;
+}
 
-    // If here, there should be data.
-    result = snd_seq_event_input( apiData->seq, &ev );
-    if ( result == -ENOSPC ) {
-      std::cerr << "\nMidiInAlsa::alsaMidiHandler: MIDI input buffer overrun!\n\n";
-      continue;
+// Opens the shared client on first use, 0 if it can not be.
+static snd_seq_t *alsaSharedOpen( void )
+{
+  AlsaSharedClient &S = alsaShared;
+  pthread_mutex_lock( &S.clientLock );
+  if ( !S.seq ) {
+    if ( snd_seq_open( &S.seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK ) < 0 ) {
+      S.seq = 0;
+      pthread_mutex_unlock( &S.clientLock );
+      return 0;
     }
-    else if ( result <= 0 ) {
-      std::cerr << "\nMidiInAlsa::alsaMidiHandler: unknown MIDI input error!\n";
-      perror("System reports");
-      continue;
+    snd_seq_set_client_name( S.seq, S.name.c_str() );
+#ifndef AVOID_TIMESTAMPING
+    // One queue stamps every input, running while the client is open
+    S.queue_id = snd_seq_alloc_named_queue( S.seq, "RtMidi Queue" );
+    snd_seq_queue_tempo_t *qtempo;
+    snd_seq_queue_tempo_alloca( &qtempo );
+    snd_seq_queue_tempo_set_tempo( qtempo, 600000 );
+    snd_seq_queue_tempo_set_ppq( qtempo, 240 );
+    snd_seq_set_queue_tempo( S.seq, S.queue_id, qtempo );
+    snd_seq_start_queue( S.seq, S.queue_id, NULL );
+    snd_seq_drain_output( S.seq );
+#endif
+  }
+  S.users++;
+  pthread_mutex_unlock( &S.clientLock );
+  return S.seq;
+}
+
+// Closes the shared client once its last user is gone.
+static void alsaSharedRelease( void )
+{
+  AlsaSharedClient &S = alsaShared;
+  pthread_mutex_lock( &S.clientLock );
+  if ( --S.users == 0 ) {
+    if ( S.reading ) {
+      S.reading = false;
+      int res = write( S.trigger_fds[1], &S.reading, sizeof( S.reading ) );
+      (void) res;
+      pthread_join( S.thread, NULL );
+      close( S.trigger_fds[0] );
+      close( S.trigger_fds[1] );
+      S.trigger_fds[0] = S.trigger_fds[1] = -1;
     }
+#ifndef AVOID_TIMESTAMPING
+    snd_seq_free_queue( S.seq, S.queue_id );
+    S.queue_id = -1;
+#endif
+    snd_seq_close( S.seq );
+    S.seq = 0;
+  }
+  pthread_mutex_unlock( &S.clientLock );
+}
 
-    // This is a bit weird, but we now have to decode an ALSA MIDI
-    // event (back) into MIDI bytes.  We'll ignore non-MIDI types.
-    if ( !continueSysex ) message.bytes.clear();
+// Hands what arrives on our port 'vport' to an input, starting the
+// reader for the first one.
+static bool alsaSharedListen( MidiInApi::RtMidiInData *data, int vport )
+{
+  AlsaSharedClient &S = alsaShared;
+  pthread_mutex_lock( &S.inputsLock );
+  S.inputs[vport] = data;
+  pthread_mutex_unlock( &S.inputsLock );
 
-    doDecode = false;
-    switch ( ev->type ) {
+  pthread_mutex_lock( &S.clientLock );
+  bool ok = S.reading;
+  if ( !ok && pipe( S.trigger_fds ) == 0 ) {
+    pthread_attr_t attr;
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE );
+    pthread_attr_setschedpolicy( &attr, SCHED_OTHER );
+    S.reading = true;
+    ok = pthread_create( &S.thread, &attr, alsaSharedHandler, 0 ) == 0;
+    pthread_attr_destroy( &attr );
+    if ( !ok ) {
+      S.reading = false;
+      close( S.trigger_fds[0] );
+      close( S.trigger_fds[1] );
+      S.trigger_fds[0] = S.trigger_fds[1] = -1;
+    }
+  }
+  pthread_mutex_unlock( &S.clientLock );
+  if ( !ok ) {
+    pthread_mutex_lock( &S.inputsLock );
+    S.inputs.erase( vport );
+    pthread_mutex_unlock( &S.inputsLock );
+  }
+  return ok;
+}
 
-    case SND_SEQ_EVENT_PORT_SUBSCRIBED:
-#if defined(__RTMIDI_DEBUG__)
-      std::cout << "MidiInAlsa::alsaMidiHandler: port connection made!\n";
-#endif
-      break;
+static void alsaSharedIgnore( int vport )
+{
+  AlsaSharedClient &S = alsaShared;
+  pthread_mutex_lock( &S.inputsLock );
+  S.inputs.erase( vport );
+  pthread_mutex_unlock( &S.inputsLock );
+}
 
-    case SND_SEQ_EVENT_PORT_UNSUBSCRIBED:
-#if defined(__RTMIDI_DEBUG__)
-      std::cerr << "MidiInAlsa::alsaMidiHandler: port connection has closed!\n";
-      std::cout << "sender = " << (int) ev->data.connect.sender.client << ":"
-                << (int) ev->data.connect.sender.port
-                << ", dest = " << (int) ev->data.connect.dest.client << ":"
-                << (int) ev->data.connect.dest.port
-                << std::endl;
-#endif
-      break;
-
-    case SND_SEQ_EVENT_QFRAME: // MIDI time code
-      if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
-      break;
-
-    case SND_SEQ_EVENT_TICK: // 0xF9 ... MIDI timing tick
-      if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
-      break;
-
-    case SND_SEQ_EVENT_CLOCK: // 0xF8 ... MIDI timing (clock) tick
-      if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
-      break;
-
-    case SND_SEQ_EVENT_SENSING: // Active sensing
-      if ( !( data->ignoreFlags & 0x04 ) ) doDecode = true;
-      break;
-
-    case SND_SEQ_EVENT_SYSEX:
-      if ( (data->ignoreFlags & 0x01) ) break;
-      if ( ev->data.ext.len > apiData->bufferSize ) {
-        apiData->bufferSize = ev->data.ext.len;
-        free( buffer );
-        buffer = (unsigned char *) malloc( apiData->bufferSize );
-        if ( buffer == NULL ) {
-          data->doInput = false;
-          std::cerr << "\nMidiInAlsa::alsaMidiHandler: error resizing buffer memory!\n\n";
-          break;
-        }
-      }
-      doDecode = true;
-      break;
+void RtMidiAlsaClient :: share( const std::string &clientName )
+{
+  alsaShared.name = clientName;
+  alsaShared.enabled = true;
+}
 
-    default:
-      doDecode = true;
-    }
+bool RtMidiAlsaClient :: isShared( void )
+{
+  return alsaShared.enabled;
+}
 
-    if ( doDecode ) {
-
-      nBytes = snd_midi_event_decode( apiData->coder, buffer, apiData->bufferSize, ev );
-      if ( nBytes > 0 ) {
-        // The ALSA sequencer has a maximum buffer size for MIDI sysex
-        // events of 256 bytes.  If a device sends sysex messages larger
-        // than this, they are segmented into 256 byte chunks.  So,
-        // we'll watch for this and concatenate sysex chunks into a
-        // single sysex message if necessary.
-        if ( !continueSysex )
-          message.bytes.assign( buffer, &buffer[nBytes] );
-        else
-          message.bytes.insert( message.bytes.end(), buffer, &buffer[nBytes] );
-
-        continueSysex = ( ( ev->type == SND_SEQ_EVENT_SYSEX ) && ( message.bytes.back() != 0xF7 ) );
-        if ( !continueSysex ) {
-
-          // Calculate the time stamp:
-          message.timeStamp = 0.0;
-
-          // Method 1: Use the system time.
-          //(void)gettimeofday(&tv, (struct timezone *)NULL);
-          //time = (tv.tv_sec * 1000000) + tv.tv_usec;
-
-          // Method 2: Use the ALSA sequencer event time data.
-          // (thanks to Pedro Lopez-Cabanillas!).
-
-          // Using method from:
-          // https://www.gnu.org/software/libc/manual/html_node/Elapsed-Time.html
-
-          // Perform the carry for the later subtraction by updating y.
-          // Temp var y is timespec because computation requires signed types,
-          // while snd_seq_real_time_t has unsigned types.
-          snd_seq_real_time_t &x( ev->time.time );
-          struct timespec y;
-          y.tv_nsec = apiData->lastTime.tv_nsec;
-          y.tv_sec = apiData->lastTime.tv_sec;
-          if ( x.tv_nsec < (unsigned int)y.tv_nsec ) {
-              int nsec = (y.tv_nsec - (int)x.tv_nsec) / 1000000000 + 1;
-              y.tv_nsec -= 1000000000 * nsec;
-              y.tv_sec += nsec;
-          }
-          if ( x.tv_nsec - y.tv_nsec > 1000000000 ) {
-              int nsec = ((int)x.tv_nsec - y.tv_nsec) / 1000000000;
-              y.tv_nsec += 1000000000 * nsec;
-              y.tv_sec -= nsec;
-          }
+int RtMidiAlsaClient :: getClientId( void )
+{
+  return alsaShared.seq ? snd_seq_client_id( alsaShared.seq ) : -1;
+}
+
+// Marks the ALSA event types a MIDI status byte decodes from. Channel
+// messages go by their upper nibble.
+static void alsaEventTypes( unsigned char status, std::vector<bool> &types )
+{
+  switch ( status < 0xF0 ? status & 0xF0 : status ) {
+  case 0x80: types[SND_SEQ_EVENT_NOTEOFF] = true; break;
+  case 0x90:
+    types[SND_SEQ_EVENT_NOTEON] = true;
+    types[SND_SEQ_EVENT_NOTE] = true;
+    break;
+  case 0xA0: types[SND_SEQ_EVENT_KEYPRESS] = true; break;
+  case 0xB0:
+    types[SND_SEQ_EVENT_CONTROLLER] = true;
+    types[SND_SEQ_EVENT_CONTROL14] = true;
+    types[SND_SEQ_EVENT_NONREGPARAM] = true;
+    types[SND_SEQ_EVENT_REGPARAM] = true;
+    break;
+  case 0xC0: types[SND_SEQ_EVENT_PGMCHANGE] = true; break;
+  case 0xD0: types[SND_SEQ_EVENT_CHANPRESS] = true; break;
+  case 0xE0: types[SND_SEQ_EVENT_PITCHBEND] = true; break;
+  case 0xF0: types[SND_SEQ_EVENT_SYSEX] = true; break;
+  case 0xF1: types[SND_SEQ_EVENT_QFRAME] = true; break;
+  case 0xF2: types[SND_SEQ_EVENT_SONGPOS] = true; break;
+  case 0xF3: types[SND_SEQ_EVENT_SONGSEL] = true; break;
+  case 0xF6: types[SND_SEQ_EVENT_TUNE_REQUEST] = true; break;
+  case 0xF8: types[SND_SEQ_EVENT_CLOCK] = true; break;
+  case 0xF9: types[SND_SEQ_EVENT_TICK] = true; break;
+  case 0xFA: types[SND_SEQ_EVENT_START] = true; break;
+  case 0xFB: types[SND_SEQ_EVENT_CONTINUE] = true; break;
+  case 0xFC: types[SND_SEQ_EVENT_STOP] = true; break;
+  case 0xFE: types[SND_SEQ_EVENT_SENSING] = true; break;
+  case 0xFF: types[SND_SEQ_EVENT_RESET] = true; break;
+  }
+}
 
-          // Compute the time difference.
-          time = (int)x.tv_sec - y.tv_sec + ((int)x.tv_nsec - y.tv_nsec)*1e-9;
+bool RtMidiAlsaClient :: setEventFilter( RtMidiIn &in, const std::vector<unsigned char> &statuses )
+{
+  if ( in.getCurrentApi() != RtMidi::LINUX_ALSA ) return false;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (in.rtapi_->apiData_);
+  if ( !data ) return false;
 
-          apiData->lastTime = ev->time.time;
+  std::vector<bool> types( 256, false );
+  for ( size_t i = 0; i < statuses.size(); i++ )
+    alsaEventTypes( statuses[i], types );
 
-          if ( data->firstMessage == true )
-            data->firstMessage = false;
-          else
-            message.timeStamp = time;
-        }
-        else {
-#if defined(__RTMIDI_DEBUG__)
-          std::cerr << "\nMidiInAlsa::alsaMidiHandler: event parsing error or not a MIDI event!\n\n";
-#endif
-        }
-      }
-    }
+  // One get/set for the whole filter rather than one per type
+  snd_seq_client_info_t *cinfo;
+  snd_seq_client_info_alloca( &cinfo );
+  if ( snd_seq_get_client_info( data->seq, cinfo ) < 0 ) return false;
+  snd_seq_client_info_event_filter_clear( cinfo );
+  for ( int t = 0; t < 256; t++ )
+    if ( types[t] ) snd_seq_client_info_event_filter_add( cinfo, t );
+  return snd_seq_set_client_info( data->seq, cinfo ) >= 0;
+}
 
-    snd_seq_free_event( ev );
-    if ( message.bytes.size() == 0 || continueSysex ) continue;
+bool RtMidiAlsaClient :: route( RtMidiIn &in, RtMidiOut &out,
+                                const std::vector<unsigned char> &statuses,
+                                ForwardCallback callback, void *userData )
+{
+  if ( in.getCurrentApi() != RtMidi::LINUX_ALSA || out.getCurrentApi() != RtMidi::LINUX_ALSA )
+    return false;
+  AlsaMidiData *from = static_cast<AlsaMidiData *> (in.rtapi_->apiData_);
+  AlsaMidiData *to = static_cast<AlsaMidiData *> (out.rtapi_->apiData_);
+  if ( !from || !to || !from->shared || !to->shared ) return false;
+
+  std::vector<bool> forward( 256, false );
+  for ( size_t i = 0; i < statuses.size(); i++ )
+    if ( statuses[i] < 0xF0 ) alsaEventTypes( statuses[i], forward );
+
+  pthread_mutex_lock( &alsaShared.inputsLock );
+  to->forwardCallback = callback;
+  to->forwardUserData = userData;
+  from->forward = forward;
+  for ( size_t i = 0; i < from->routes.size(); i++ )
+    if ( from->routes[i] == to ) to = 0;
+  if ( to ) from->routes.push_back( to );
+  alsaShared.routed.insert( from );
+  pthread_mutex_unlock( &alsaShared.inputsLock );
+  return true;
+}
 
-    if ( data->usingCallback ) {
-      RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-      callback( message.timeStamp, &message.bytes, data->userData );
-    }
-    else {
-      // As long as we haven't reached our queue size limit, push the message.
-      if ( !data->queue.push( message ) )
-        std::cerr << "\nMidiInAlsa: message queue limit reached!!\n\n";
-    }
-  }
+void RtMidiAlsaClient :: unroute( RtMidiIn &in )
+{
+  if ( in.getCurrentApi() != RtMidi::LINUX_ALSA ) return;
+  AlsaMidiData *from = static_cast<AlsaMidiData *> (in.rtapi_->apiData_);
+  if ( !from || !from->shared ) return;
+  pthread_mutex_lock( &alsaShared.inputsLock );
+  from->routes.clear();
+  alsaShared.routed.erase( from );
+  pthread_mutex_unlock( &alsaShared.inputsLock );
+}
 
-  if ( buffer ) free( buffer );
-  snd_midi_event_free( apiData->coder );
-  apiData->coder = 0;
-  apiData->thread = apiData->dummy_thread_id;
-  return 0;
+bool RtMidiAlsaClient :: sendAfter( RtMidiOut &out, const unsigned char *message,
+                                    size_t size, double delay )
+{
+  if ( out.getCurrentApi() != RtMidi::LINUX_ALSA ) return false;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (out.rtapi_->apiData_);
+  if ( !data || !data->shared || alsaShared.queue_id < 0 ) return false;
+  static_cast<MidiOutAlsa *> (out.rtapi_)->sendAfter( message, size, delay < 0 ? 0 : delay );
+  return true;
 }
 
 MidiInAlsa :: MidiInAlsa( const std::string &clientName, unsigned int queueSizeLimit )
@@ -1735,9 +2320,17 @@ MidiInAlsa :: ~MidiInAlsa()
   }
 
   // Cleanup.
+  if ( data->vport >= 0 ) snd_seq_delete_port( data->seq, data->vport );
+  if ( data->shared ) {
+    pthread_mutex_lock( &alsaShared.inputsLock );
+    alsaShared.routed.erase( data );
+    pthread_mutex_unlock( &alsaShared.inputsLock );
+    alsaSharedRelease();
+    delete data;
+    return;
+  }
   close ( data->trigger_fds[0] );
   close ( data->trigger_fds[1] );
-  if ( data->vport >= 0 ) snd_seq_delete_port( data->seq, data->vport );
 #ifndef AVOID_TIMESTAMPING
   snd_seq_free_queue( data->seq, data->queue_id );
 #endif
@@ -1747,31 +2340,42 @@ MidiInAlsa :: ~MidiInAlsa()
 
 void MidiInAlsa :: initialize( const std::string& clientName )
 {
-  // Set up the ALSA sequencer client.
+  // Set up the ALSA sequencer client, or join the shared one.
   snd_seq_t *seq;
-  int result = snd_seq_open( &seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK );
-  if ( result < 0 ) {
+  bool shared = alsaShared.enabled;
+  if ( shared ) seq = alsaSharedOpen();
+  if ( shared ? seq == 0 : snd_seq_open( &seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK ) < 0 ) {
     errorString_ = "MidiInAlsa::initialize: error creating ALSA sequencer client object.";
     error( RtMidiError::DRIVER_ERROR, errorString_ );
     return;
   }
 
   // Set client name.
-  snd_seq_set_client_name( seq, clientName.c_str() );
+  if ( !shared ) snd_seq_set_client_name( seq, clientName.c_str() );
 
   // Save our api-specific connection information.
   AlsaMidiData *data = (AlsaMidiData *) new AlsaMidiData;
   data->seq = seq;
+  data->shared = shared;
   data->portNum = -1;
   data->vport = -1;
   data->subscription = 0;
+  data->coder = 0;
+  data->buffer = 0;
   data->dummy_thread_id = pthread_self();
   data->thread = data->dummy_thread_id;
   data->trigger_fds[0] = -1;
   data->trigger_fds[1] = -1;
+  data->forwardCallback = 0;
+  data->forwardUserData = 0;
   apiData_ = (void *) data;
   inputData_.apiData = (void *) data;
 
+  if ( shared ) {
+    data->queue_id = alsaShared.queue_id;
+    return;
+  }
+
   if ( pipe(data->trigger_fds) == -1 ) {
     errorString_ = "MidiInAlsa::initialize: error creating pipe objects.";
     error( RtMidiError::DRIVER_ERROR, errorString_ );
@@ -1942,7 +2546,20 @@ void MidiInAlsa :: openPort( unsigned int portNumber, const std::string &portNam
     }
   }
 
-  if ( inputData_.doInput == false ) {
+  if ( inputData_.doInput == false && data->shared ) {
+    inputData_.doInput = true;
+    if ( !alsaInputStart( &inputData_ ) || !alsaSharedListen( &inputData_, data->vport ) ) {
+      alsaInputStop( &inputData_ );
+      snd_seq_unsubscribe_port( data->seq, data->subscription );
+      snd_seq_port_subscribe_free( data->subscription );
+      data->subscription = 0;
+      inputData_.doInput = false;
+      errorString_ = "MidiInAlsa::openPort: error starting MIDI input thread!";
+      error( RtMidiError::THREAD_ERROR, errorString_ );
+      return;
+    }
+  }
+  else if ( inputData_.doInput == false ) {
     // Start the input queue
 #ifndef AVOID_TIMESTAMPING
     snd_seq_start_queue( data->seq, data->queue_id, NULL );
@@ -2000,7 +2617,17 @@ void MidiInAlsa :: openVirtualPort( const std::string &portName )
     data->vport = snd_seq_port_info_get_port( pinfo );
   }
 
-  if ( inputData_.doInput == false ) {
+  if ( inputData_.doInput == false && data->shared ) {
+    inputData_.doInput = true;
+    if ( !alsaInputStart( &inputData_ ) || !alsaSharedListen( &inputData_, data->vport ) ) {
+      alsaInputStop( &inputData_ );
+      inputData_.doInput = false;
+      errorString_ = "MidiInAlsa::openPort: error starting MIDI input thread!";
+      error( RtMidiError::THREAD_ERROR, errorString_ );
+      return;
+    }
+  }
+  else if ( inputData_.doInput == false ) {
     // Wait for old thread to stop, if still running
     if ( !pthread_equal( data->thread, data->dummy_thread_id ) )
       pthread_join( data->thread, NULL );
@@ -2043,16 +2670,23 @@ void MidiInAlsa :: closePort( void )
       snd_seq_port_subscribe_free( data->subscription );
       data->subscription = 0;
     }
-    // Stop the input queue
+    // Stop the input queue, unless other ports share it
 #ifndef AVOID_TIMESTAMPING
-    snd_seq_stop_queue( data->seq, data->queue_id, NULL );
-    snd_seq_drain_output( data->seq );
+    if ( !data->shared ) {
+      snd_seq_stop_queue( data->seq, data->queue_id, NULL );
+      snd_seq_drain_output( data->seq );
+    }
 #endif
     connected_ = false;
   }
 
   // Stop thread to avoid triggering the callback, while the port is intended to be closed
-  if ( inputData_.doInput ) {
+  if ( inputData_.doInput && data->shared ) {
+    alsaSharedIgnore( data->vport );
+    inputData_.doInput = false;
+    alsaInputStop( &inputData_ );
+  }
+  else if ( inputData_.doInput ) {
     inputData_.doInput = false;
     int res = write( data->trigger_fds[1], &inputData_.doInput, sizeof( inputData_.doInput ) );
     (void) res;
@@ -2099,32 +2733,47 @@ MidiOutAlsa :: ~MidiOutAlsa()
   if ( data->vport >= 0 ) snd_seq_delete_port( data->seq, data->vport );
   if ( data->coder ) snd_midi_event_free( data->coder );
   if ( data->buffer ) free( data->buffer );
-  snd_seq_close( data->seq );
+  if ( data->shared ) {
+    // Nothing may be forwarded to this port any more
+    pthread_mutex_lock( &alsaShared.inputsLock );
+    std::set<AlsaMidiData *>::iterator it = alsaShared.routed.begin();
+    for ( ; it != alsaShared.routed.end(); ++it ) {
+      std::vector<AlsaMidiData *> &routes = (*it)->routes;
+      routes.erase( std::remove( routes.begin(), routes.end(), data ), routes.end() );
+    }
+    pthread_mutex_unlock( &alsaShared.inputsLock );
+    alsaSharedRelease();
+  }
+  else snd_seq_close( data->seq );
   delete data;
 }
 
 void MidiOutAlsa :: initialize( const std::string& clientName )
 {
-  // Set up the ALSA sequencer client.
+  // Set up the ALSA sequencer client, or join the shared one.
   snd_seq_t *seq;
-  int result1 = snd_seq_open( &seq, "default", SND_SEQ_OPEN_OUTPUT, SND_SEQ_NONBLOCK );
-  if ( result1 < 0 ) {
+  bool shared = alsaShared.enabled;
+  if ( shared ) seq = alsaSharedOpen();
+  if ( shared ? seq == 0 : snd_seq_open( &seq, "default", SND_SEQ_OPEN_OUTPUT, SND_SEQ_NONBLOCK ) < 0 ) {
     errorString_ = "MidiOutAlsa::initialize: error creating ALSA sequencer client object.";
     error( RtMidiError::DRIVER_ERROR, errorString_ );
     return;
   }
 
   // Set client name.
-  snd_seq_set_client_name( seq, clientName.c_str() );
+  if ( !shared ) snd_seq_set_client_name( seq, clientName.c_str() );
 
   // Save our api-specific connection information.
   AlsaMidiData *data = (AlsaMidiData *) new AlsaMidiData;
   data->seq = seq;
+  data->shared = shared;
   data->portNum = -1;
   data->vport = -1;
   data->bufferSize = 32;
   data->coder = 0;
   data->buffer = 0;
+  data->forwardCallback = 0;
+  data->forwardUserData = 0;
   int result = snd_midi_event_new( data->bufferSize, &data->coder );
   if ( result < 0 ) {
     delete data;
@@ -2292,6 +2941,13 @@ void MidiOutAlsa :: openVirtualPort( const std::string &portName )
 }
 
 void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
+{
+  sendAfter( message, size, -1 );
+}
+
+// A negative delay sends directly, anything else schedules the event on
+// the shared client's queue that many seconds from its current time.
+void MidiOutAlsa :: sendAfter( const unsigned char *message, size_t size, double delay )
 {
   int result;
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
@@ -2317,7 +2973,13 @@ void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
   snd_seq_ev_clear( &ev );
   snd_seq_ev_set_source( &ev, data->vport );
   snd_seq_ev_set_subs( &ev );
-  snd_seq_ev_set_direct( &ev );
+  if ( delay < 0 ) snd_seq_ev_set_direct( &ev );
+  else {
+    snd_seq_real_time_t when;
+    when.tv_sec = (unsigned int) delay;
+    when.tv_nsec = (unsigned int) ( ( delay - when.tv_sec ) * 1000000000.0 );
+    snd_seq_ev_schedule_real( &ev, alsaShared.queue_id, 1, &when );
+  }
   for ( unsigned int i=0; i<nBytes; ++i ) data->buffer[i] = message[i];
   result = snd_midi_event_encode( data->coder, data->buffer, (long)nBytes, &ev );
   if ( result < (int)nBytes ) {
@@ -2326,14 +2988,16 @@ void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
     return;
   }
 
-  // Send the event.
+  // Send the event. The shared client's output buffer is everyone's.
+  if ( data->shared ) pthread_mutex_lock( &alsaShared.outputLock );
   result = snd_seq_event_output( data->seq, &ev );
+  if ( result >= 0 ) snd_seq_drain_output( data->seq );
+  if ( data->shared ) pthread_mutex_unlock( &alsaShared.outputLock );
   if ( result < 0 ) {
     errorString_ = "MidiOutAlsa::sendMessage: error sending MIDI message to port.";
     error( RtMidiError::WARNING, errorString_ );
     return;
   }
-  snd_seq_drain_output( data->seq );
 }
 
 #endif // __LINUX_ALSA__
@@ -3443,3 +4107,497 @@ void MidiOutJack :: sendMessage( const unsigned char *message, size_t size )
 }
 
 #endif  // __UNIX_JACK__
+
+
+//*********************************************************************//
+//  API: In-process loopback
+//  Class Definitions: MidiInLoopback, MidiOutLoopback, RtMidiLoopback
+//*********************************************************************//
+
+#if defined(__RTMIDI_LOOPBACK__)
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#define LOOPBACK_FIXED_PORTS 4
+#define LOOPBACK_DEFAULT_MESSAGES 65536
+#define LOOPBACK_DEFAULT_BYTES (1 << 20)
+
+// Ports are never freed. A virtual port whose owner closes it is only
+// marked dead, so outputs and the record can keep pointing at it, and it
+// comes back to life if a port of the same name is opened again.
+struct LoopbackPort {
+  std::string name;
+  unsigned int index; // in LoopbackData::ports
+  bool alive;
+  std::vector<MidiInLoopback *> inputs;
+};
+
+struct LoopbackRecord {
+  double time;
+  unsigned int port;
+  size_t offset, size; // in LoopbackData::bytes
+};
+
+struct LoopbackData {
+  // Ports and delivery. Recursive so an input callback may itself send.
+  std::recursive_mutex lock;
+  std::vector<LoopbackPort *> ports;
+
+  std::mutex recordLock;
+  std::vector<LoopbackRecord> records;
+  std::vector<unsigned char> bytes;
+  size_t count, used;
+  unsigned long overflow;
+  std::chrono::steady_clock::time_point start;
+
+  std::mutex playerLock;
+  std::vector<std::thread> players;
+  std::atomic<bool> stopPlayers;
+
+  LoopbackData() : count(0), used(0), overflow(0), start(std::chrono::steady_clock::now()), stopPlayers(false) {
+    for ( unsigned int i=0; i<LOOPBACK_FIXED_PORTS; i++ ) {
+      std::ostringstream name;
+      name << "Loopback " << i + 1;
+      addPort( name.str() );
+    }
+  }
+
+  LoopbackPort *addPort( const std::string &name ) {
+    LoopbackPort *port = new LoopbackPort();
+    port->name = name;
+    port->index = ports.size();
+    port->alive = true;
+    ports.push_back( port );
+    return port;
+  }
+};
+
+// Shared by every loopback client in the process, built on first use.
+static LoopbackData &loopbackData( void )
+{
+  static LoopbackData data;
+  return data;
+}
+
+static double loopbackTime( void )
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now() - loopbackData().start ).count();
+}
+
+// The following helpers expect loopbackData().lock to be held.
+
+static unsigned int loopbackPortCount( void )
+{
+  LoopbackData &data = loopbackData();
+  unsigned int n = 0;
+  for ( size_t i=0; i<data.ports.size(); i++ )
+    if ( data.ports[i]->alive ) n++;
+  return n;
+}
+
+static LoopbackPort *loopbackPort( unsigned int portNumber )
+{
+  LoopbackData &data = loopbackData();
+  for ( size_t i=0; i<data.ports.size(); i++ ) {
+    if ( !data.ports[i]->alive ) continue;
+    if ( portNumber-- == 0 ) return data.ports[i];
+  }
+  return 0;
+}
+
+static LoopbackPort *loopbackFind( const std::string &name )
+{
+  LoopbackData &data = loopbackData();
+  for ( size_t i=0; i<data.ports.size(); i++ )
+    if ( data.ports[i]->alive && data.ports[i]->name == name ) return data.ports[i];
+  for ( size_t i=0; i<data.ports.size(); i++ )
+    if ( data.ports[i]->alive && data.ports[i]->name.find( name ) != std::string::npos ) return data.ports[i];
+  return 0;
+}
+
+static LoopbackPort *loopbackVirtual( const std::string &name )
+{
+  LoopbackData &data = loopbackData();
+  for ( size_t i=LOOPBACK_FIXED_PORTS; i<data.ports.size(); i++ ) {
+    if ( !data.ports[i]->alive && data.ports[i]->name == name ) {
+      data.ports[i]->alive = true;
+      return data.ports[i];
+    }
+  }
+  return data.addPort( name );
+}
+
+static void loopbackDeliver( LoopbackPort *port, const unsigned char *message, size_t size )
+{
+  for ( size_t i=0; i<port->inputs.size(); i++ )
+    port->inputs[i]->deliver( message, size );
+}
+
+static void loopbackDetach( LoopbackPort *port, MidiInLoopback *input )
+{
+  std::vector<MidiInLoopback *> &inputs = port->inputs;
+  for ( size_t i=0; i<inputs.size(); i++ ) {
+    if ( inputs[i] == input ) {
+      inputs.erase( inputs.begin() + i );
+      return;
+    }
+  }
+}
+
+//*********************************************************************//
+//  API: Loopback
+//  Class Definitions: MidiInLoopback
+//*********************************************************************//
+
+MidiInLoopback :: MidiInLoopback( const std::string &clientName, unsigned int queueSizeLimit )
+  : MidiInApi( queueSizeLimit ), port_( 0 ), owner_( false ), lastTime_( 0.0 )
+{
+  MidiInLoopback::initialize( clientName );
+}
+
+MidiInLoopback :: ~MidiInLoopback()
+{
+  MidiInLoopback::closePort();
+}
+
+void MidiInLoopback :: initialize( const std::string& /*clientName*/ )
+{
+  // Nothing to connect to. Room for the largest message we expect, so
+  // delivery does not allocate.
+  inputData_.message.bytes.reserve( 1024 );
+}
+
+void MidiInLoopback :: openPort( unsigned int portNumber, const std::string &/*portName*/ )
+{
+  if ( connected_ ) {
+    errorString_ = "MidiInLoopback::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  LoopbackPort *port = loopbackPort( portNumber );
+  if ( !port ) {
+    std::ostringstream ost;
+    ost << "MidiInLoopback::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+  port->inputs.push_back( this );
+  port_ = port;
+  owner_ = false;
+  inputData_.firstMessage = true;
+  connected_ = true;
+}
+
+void MidiInLoopback :: openVirtualPort( const std::string &portName )
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  if ( port_ ) return;
+  port_ = loopbackVirtual( portName );
+  port_->inputs.push_back( this );
+  owner_ = true;
+  inputData_.firstMessage = true;
+}
+
+void MidiInLoopback :: closePort( void )
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  if ( port_ ) {
+    loopbackDetach( port_, this );
+    if ( owner_ ) port_->alive = false;
+  }
+  port_ = 0;
+  owner_ = false;
+  connected_ = false;
+}
+
+unsigned int MidiInLoopback :: getPortCount()
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  return loopbackPortCount();
+}
+
+std::string MidiInLoopback :: getPortName( unsigned int portNumber )
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  LoopbackPort *port = loopbackPort( portNumber );
+  if ( port ) return port->name;
+
+  std::ostringstream ost;
+  ost << "MidiInLoopback::getPortName: the 'portNumber' argument (" << portNumber << ") is invalid.";
+  errorString_ = ost.str();
+  error( RtMidiError::WARNING, errorString_ );
+  return std::string();
+}
+
+// Called with the loopback lock held, on the sending thread.
+void MidiInLoopback :: deliver( const unsigned char *message, size_t size )
+{
+  if ( size == 0 ) return;
+
+  // Same filtering as the ALSA input thread.
+  unsigned char status = message[0];
+  if ( ( status == 0xF0 && ( inputData_.ignoreFlags & 0x01 ) ) ||
+       ( ( status == 0xF1 || status == 0xF8 ) && ( inputData_.ignoreFlags & 0x02 ) ) ||
+       ( status == 0xFE && ( inputData_.ignoreFlags & 0x04 ) ) )
+    return;
+
+  double now = loopbackTime();
+  MidiMessage &msg = inputData_.message;
+  msg.timeStamp = inputData_.firstMessage ? 0.0 : now - lastTime_;
+  inputData_.firstMessage = false;
+  lastTime_ = now;
+
+  if ( inputData_.spanCallback ) {
+    RtMidiIn::MessageInfo info = { msg.timeStamp, (unsigned int) now,
+                                   (unsigned int) ( ( now - (unsigned int) now ) * 1e9 ), -1, -1 };
+    inputData_.spanCallback( message, size, info, inputData_.spanUserData );
+    return;
+  }
+
+  msg.bytes.assign( message, message + size );
+  if ( inputData_.usingCallback ) {
+    inputData_.userCallback( msg.timeStamp, &msg.bytes, inputData_.userData );
+  }
+  else if ( !inputData_.queue.push( msg ) ) {
+    error( RtMidiError::WARNING, "MidiInLoopback: message queue limit reached!!" );
+  }
+}
+
+//*********************************************************************//
+//  API: Loopback
+//  Class Definitions: MidiOutLoopback
+//*********************************************************************//
+
+MidiOutLoopback :: MidiOutLoopback( const std::string &clientName )
+  : MidiOutApi(), port_( 0 ), owner_( false )
+{
+  MidiOutLoopback::initialize( clientName );
+}
+
+MidiOutLoopback :: ~MidiOutLoopback()
+{
+  MidiOutLoopback::closePort();
+}
+
+void MidiOutLoopback :: initialize( const std::string& /*clientName*/ )
+{
+  LoopbackData &data = loopbackData();
+  bool reserved;
+  {
+    std::lock_guard<std::mutex> lk( data.recordLock );
+    reserved = !data.records.empty();
+  }
+  if ( !reserved ) RtMidiLoopback::reserve( LOOPBACK_DEFAULT_MESSAGES, LOOPBACK_DEFAULT_BYTES );
+}
+
+void MidiOutLoopback :: openPort( unsigned int portNumber, const std::string &/*portName*/ )
+{
+  if ( connected_ ) {
+    errorString_ = "MidiOutLoopback::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  LoopbackPort *port = loopbackPort( portNumber );
+  if ( !port ) {
+    std::ostringstream ost;
+    ost << "MidiOutLoopback::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+  port_ = port;
+  owner_ = false;
+  connected_ = true;
+}
+
+void MidiOutLoopback :: openVirtualPort( const std::string &portName )
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  if ( port_ ) return;
+  port_ = loopbackVirtual( portName );
+  owner_ = true;
+}
+
+void MidiOutLoopback :: closePort( void )
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  if ( port_ && owner_ ) port_->alive = false;
+  port_ = 0;
+  owner_ = false;
+  connected_ = false;
+}
+
+unsigned int MidiOutLoopback :: getPortCount()
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  return loopbackPortCount();
+}
+
+std::string MidiOutLoopback :: getPortName( unsigned int portNumber )
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  LoopbackPort *port = loopbackPort( portNumber );
+  if ( port ) return port->name;
+
+  std::ostringstream ost;
+  ost << "MidiOutLoopback::getPortName: the 'portNumber' argument (" << portNumber << ") is invalid.";
+  errorString_ = ost.str();
+  error( RtMidiError::WARNING, errorString_ );
+  return std::string();
+}
+
+void MidiOutLoopback :: sendMessage( const unsigned char *message, size_t size )
+{
+  LoopbackData &data = loopbackData();
+  std::lock_guard<std::recursive_mutex> lk( data.lock );
+  if ( !port_ ) {
+    errorString_ = "MidiOutLoopback::sendMessage: no open port to send to.";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> rlk( data.recordLock );
+    if ( data.count == data.records.size() || size > data.bytes.size() - data.used ) {
+      data.overflow++;
+    }
+    else {
+      LoopbackRecord &record = data.records[data.count++];
+      record.time = loopbackTime();
+      record.port = port_->index;
+      record.offset = data.used;
+      record.size = size;
+      memcpy( &data.bytes[data.used], message, size );
+      data.used += size;
+    }
+  }
+
+  loopbackDeliver( port_, message, size );
+}
+
+//*********************************************************************//
+//  API: Loopback
+//  Class Definitions: RtMidiLoopback
+//*********************************************************************//
+
+void RtMidiLoopback :: reserve( size_t messages, size_t bytes )
+{
+  LoopbackData &data = loopbackData();
+  std::lock_guard<std::mutex> lk( data.recordLock );
+  data.records.resize( messages );
+  data.bytes.resize( bytes );
+  data.count = data.used = 0;
+  data.overflow = 0;
+  data.start = std::chrono::steady_clock::now();
+}
+
+void RtMidiLoopback :: clear( void )
+{
+  LoopbackData &data = loopbackData();
+  std::lock_guard<std::mutex> lk( data.recordLock );
+  data.count = data.used = 0;
+  data.overflow = 0;
+  data.start = std::chrono::steady_clock::now();
+}
+
+size_t RtMidiLoopback :: getRecordCount( void )
+{
+  LoopbackData &data = loopbackData();
+  std::lock_guard<std::mutex> lk( data.recordLock );
+  return data.count;
+}
+
+unsigned long RtMidiLoopback :: getOverflow( void )
+{
+  LoopbackData &data = loopbackData();
+  std::lock_guard<std::mutex> lk( data.recordLock );
+  return data.overflow;
+}
+
+bool RtMidiLoopback :: getRecord( size_t index, double *time, std::string *port,
+                                  std::vector<unsigned char> *message )
+{
+  LoopbackData &data = loopbackData();
+  unsigned int portIndex;
+  {
+    std::lock_guard<std::mutex> lk( data.recordLock );
+    if ( index >= data.count ) return false;
+    const LoopbackRecord &record = data.records[index];
+    if ( time ) *time = record.time;
+    if ( message ) message->assign( &data.bytes[record.offset], &data.bytes[record.offset] + record.size );
+    portIndex = record.port;
+  }
+  if ( port ) {
+    std::lock_guard<std::recursive_mutex> lk( data.lock );
+    *port = data.ports[portIndex]->name;
+  }
+  return true;
+}
+
+bool RtMidiLoopback :: inject( const std::string &port, const unsigned char *message, size_t size )
+{
+  std::lock_guard<std::recursive_mutex> lk( loopbackData().lock );
+  LoopbackPort *target = loopbackFind( port );
+  if ( !target ) return false;
+  loopbackDeliver( target, message, size );
+  return true;
+}
+
+static void loopbackPlayer( std::string port, std::vector<std::vector<unsigned char> > messages, double rate )
+{
+  LoopbackData &data = loopbackData();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for ( size_t i=0; i<messages.size() && !data.stopPlayers; i++ ) {
+    // Scheduled from the start rather than the previous message, so the
+    // rate holds on average even if a delivery runs late.
+    if ( rate > 0 )
+      std::this_thread::sleep_until( start + std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>( i / rate ) ) );
+    if ( !messages[i].empty() )
+      RtMidiLoopback::inject( port, &messages[i][0], messages[i].size() );
+  }
+}
+
+bool RtMidiLoopback :: play( const std::string &port,
+                             const std::vector<std::vector<unsigned char> > &messages,
+                             double rate )
+{
+  LoopbackData &data = loopbackData();
+  {
+    std::lock_guard<std::recursive_mutex> lk( data.lock );
+    if ( !loopbackFind( port ) ) return false;
+  }
+  std::lock_guard<std::mutex> lk( data.playerLock );
+  data.players.push_back( std::thread( loopbackPlayer, port, messages, rate ) );
+  return true;
+}
+
+void RtMidiLoopback :: wait( void )
+{
+  LoopbackData &data = loopbackData();
+  std::vector<std::thread> players;
+  {
+    std::lock_guard<std::mutex> lk( data.playerLock );
+    players.swap( data.players );
+  }
+  for ( size_t i=0; i<players.size(); i++ )
+    players[i].join();
+}
+
+void RtMidiLoopback :: stop( void )
+{
+  LoopbackData &data = loopbackData();
+  data.stopPlayers = true;
+  wait();
+  data.stopPlayers = false;
+}
+
+#endif  // __RTMIDI_LOOPBACK__
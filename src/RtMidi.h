@@ -144,6 +144,7 @@ public:
     UNIX_JACK,    /*!< The JACK Low-Latency MIDI Server API. */
     WINDOWS_MM,   /*!< The Microsoft Multimedia MIDI API. */
     RTMIDI_DUMMY, /*!< A compilable but non-functional API. */
+    RTMIDI_LOOPBACK, /*!< In-process ports for tests and benchmarks. */
     NUM_APIS      /*!< Number of values in this enum. */
   };
 
@@ -217,6 +218,9 @@ protected:
   RtMidi();
   virtual ~RtMidi();
   MidiApi *rtapi_;
+#if defined(__LINUX_ALSA__)
+  friend class RtMidiAlsaClient;
+#endif
 };
 
 /**********************************************************************/
@@ -255,6 +259,39 @@ public:
   //! User callback function type definition.
   typedef void (*RtMidiCallback)(double timeStamp, std::vector<unsigned char> *message, void *userData);
 
+  //! Where and when a message given to an RtMidiSpanCallback came from.
+  struct MessageInfo {
+    double timeStamp;  //!< Seconds since the previous message, as for RtMidiCallback.
+    unsigned int sec;  //!< Event time on the API's clock: the input queue's
+    unsigned int nsec; //!< real time on ALSA, the record clock on loopback.
+    int client;        //!< Sender client and port (ALSA), -1 when not known.
+    int port;
+  };
+
+  //! User callback function type receiving a read-only view of the message.
+  /*!
+    \p message points into the input's own decode buffer and is only
+    valid for the duration of the call.
+  */
+  typedef void (*RtMidiSpanCallback)(const unsigned char *message, size_t size,
+                                     const MessageInfo &info, void *userData);
+
+  //! One message of a batch, see RtMidiBatchCallback.
+  struct BatchMessage {
+    const unsigned char *message;
+    size_t size;
+    MessageInfo info;
+  };
+
+  //! User callback function type receiving every message read in one wakeup.
+  /*!
+    The messages are in arrival order and only valid for the duration
+    of the call. A burst larger than the API's batch arrives in several
+    calls.
+  */
+  typedef void (*RtMidiBatchCallback)(const BatchMessage *messages, size_t count,
+                                      void *userData);
+
   //! Default constructor that allows an optional api, client name and queue size.
   /*!
     An exception will be thrown if a MIDI system initialization
@@ -316,6 +353,30 @@ public:
   */
   void setCallback(RtMidiCallback callback, void *userData = 0);
 
+  //! Set a callback function that receives messages without a copy.
+  /*!
+    Used instead of setCallback(), not alongside it. The ALSA and
+    loopback APIs deliver straight from the bytes they decoded; the
+    others fill a vector as usual and pass a view of it, without sender
+    or event time.
+
+    \param callback A callback function must be given.
+    \param userData Optionally, a pointer passed to the callback.
+  */
+  void setSpanCallback(RtMidiSpanCallback callback, void *userData = 0);
+
+  //! Set a callback function that receives messages in batches.
+  /*!
+    Used instead of setCallback() or setSpanCallback(). The ALSA API
+    drains every event pending when its thread wakes up and hands the
+    lot over in one call, so the receiver can take its locks and wake
+    its consumers once. The other APIs deliver batches of one.
+
+    \param callback A callback function must be given.
+    \param userData Optionally, a pointer passed to the callback.
+  */
+  void setBatchCallback(RtMidiBatchCallback callback, void *userData = 0);
+
   //! Cancel use of the current callback function (if one exists).
   /*!
     Subsequent incoming MIDI messages will be written to the queue
@@ -481,6 +542,156 @@ protected:
   void openMidiApi(RtMidi::Api api, const std::string &clientName);
 };
 
+#if defined(__RTMIDI_LOOPBACK__)
+/**********************************************************************/
+/*! \class RtMidiLoopback
+    \brief Drives and observes the in-process loopback API.
+
+    With __RTMIDI_LOOPBACK__ defined the RTMIDI_LOOPBACK API is compiled
+    in ahead of every other one, so a default RtMidiIn/RtMidiOut uses
+    it. Its ports live in this process: "Loopback 1" to "Loopback 4"
+    always exist, and every virtual port adds one under its own name.
+    Whatever an RtMidiOut sends to a port is delivered to the RtMidiIn
+    ports open on it and appended to a record, a preallocated buffer,
+    so sending never allocates. A test feeds inputs with inject() or
+    play() and reads back what came out with getRecord().
+*/
+/**********************************************************************/
+
+class RTMIDI_DLL_PUBLIC RtMidiLoopback
+{
+public:
+  //! Clears the record and preallocates room for \p messages totalling \p bytes.
+  /*!
+    Messages sent once the record is full are delivered but not
+    recorded, see getOverflow(). The first loopback output reserves a
+    default size if this was never called.
+  */
+  static void reserve(size_t messages, size_t bytes);
+
+  //! Empties the record and restarts its clock, keeping the room reserved.
+  static void clear(void);
+
+  //! Number of messages recorded.
+  static size_t getRecordCount(void);
+
+  //! Number of messages that did not fit the record.
+  static unsigned long getOverflow(void);
+
+  //! Reads recorded message \p index.
+  /*!
+    \param time Seconds since the record was last cleared.
+    \param port Name of the port it was sent to.
+    \retval false if there is no such record.
+  */
+  static bool getRecord(size_t index, double *time, std::string *port,
+                        std::vector<unsigned char> *message);
+
+  //! Delivers one message to the inputs open on \p port, as if an output sent it.
+  /*!
+    The port is matched by name, exactly or else as a substring. Injected
+    messages are not recorded.
+    \retval false if no port matches.
+  */
+  static bool inject(const std::string &port, const unsigned char *message, size_t size);
+
+  //! Injects \p messages into \p port from a background thread, \p rate per second.
+  /*!
+    A rate of 0 injects as fast as it can. Several players may run at
+    once; wait() joins them all.
+    \retval false if no port matches.
+  */
+  static bool play(const std::string &port,
+                   const std::vector<std::vector<unsigned char> > &messages,
+                   double rate);
+
+  //! Waits for every player to finish.
+  static void wait(void);
+
+  //! Stops every player and waits for them.
+  static void stop(void);
+};
+#endif
+
+#if defined(__LINUX_ALSA__)
+/**********************************************************************/
+/*! \class RtMidiAlsaClient
+    \brief Puts every ALSA port in one sequencer client.
+
+    By default each ALSA RtMidiIn and RtMidiOut opens a sequencer client
+    of its own. After share(), those constructed from then on all use a
+    single client instead: one snd_seq_t owns every input and output
+    port, and one thread reads all the inputs, handing each event to the
+    RtMidiIn whose port it arrived on. The client is closed when the last
+    of them is deleted.
+*/
+/**********************************************************************/
+
+class RTMIDI_DLL_PUBLIC RtMidiAlsaClient
+{
+public:
+  //! Makes ALSA ports created from now on share one client named \p clientName.
+  static void share(const std::string &clientName);
+
+  //! True once share() was called.
+  static bool isShared(void);
+
+  //! The shared client's number, or -1 while it is not open.
+  static int getClientId(void);
+
+  //! Has the kernel deliver only MIDI messages with the given \p statuses to \p in.
+  /*!
+    Works on any ALSA input, shared or not. Everything else is dropped
+    by the sequencer before it reaches this process, rather than decoded
+    and then ignored. Channel messages go by their upper nibble (0x80 to
+    0xE0), system messages by their status byte. The filter belongs to
+    the sequencer client, so on the shared client it applies to every
+    input. An empty list lets everything through again.
+    \retval false if \p in is not an ALSA input or the filter could not be set.
+  */
+  static bool setEventFilter(RtMidiIn &in, const std::vector<unsigned char> &statuses);
+
+  //! Told about each message forwarded to an output, see route().
+  typedef void (*ForwardCallback)(const unsigned char *message, size_t size,
+                                  void *userData);
+
+  //! Forwards \p in's channel messages of the given \p statuses to \p out.
+  /*!
+    Both must be on the shared client. The reader thread re-sends
+    matching events from \p out's port as they arrive, without decoding
+    them: they never reach \p in's callback and do not wait behind what
+    \p out is sending from other threads. \p statuses are the upper
+    nibbles of channel messages, 0x80 to 0xE0. An input may be routed to
+    several outputs; they all get the same statuses, the last given.
+
+    With a \p callback, each forwarded event is decoded after it went
+    out and handed to it on the reader thread, so the owner of \p out
+    can account for it. It must not block. The last one given for \p out
+    is the one called.
+    \retval false if either is not on the shared client.
+  */
+  static bool route(RtMidiIn &in, RtMidiOut &out,
+                    const std::vector<unsigned char> &statuses,
+                    ForwardCallback callback = 0, void *userData = 0);
+
+  //! Stops forwarding anything from \p in.
+  static void unroute(RtMidiIn &in);
+
+  //! Has the kernel send \p message from \p out \p delay seconds from now.
+  /*!
+    The event is scheduled on the shared client's timestamping queue
+    instead of sent directly, so it leaves at that time however late
+    this process gets to run afterwards. Events due at the same time
+    leave in the order they were given. Send errors go to \p out's
+    error callback, as with sendMessage().
+    \retval false if \p out is not on the shared client or the client
+    has no queue (built with AVOID_TIMESTAMPING).
+  */
+  static bool sendAfter(RtMidiOut &out, const unsigned char *message,
+                        size_t size, double delay);
+};
+#endif
+
 // **************************************************************** //
 //
 // MidiInApi / MidiOutApi class declarations.
@@ -517,6 +728,9 @@ public:
 
 protected:
   virtual void initialize(const std::string &clientName) = 0;
+#if defined(__LINUX_ALSA__)
+  friend class RtMidiAlsaClient;
+#endif
 
   void *apiData_;
   bool connected_;
@@ -532,6 +746,8 @@ public:
   MidiInApi(unsigned int queueSizeLimit);
   virtual ~MidiInApi(void);
   void setCallback(RtMidiIn::RtMidiCallback callback, void *userData);
+  void setSpanCallback(RtMidiIn::RtMidiSpanCallback callback, void *userData);
+  void setBatchCallback(RtMidiIn::RtMidiBatchCallback callback, void *userData);
   void cancelCallback(void);
   virtual void ignoreTypes(bool midiSysex, bool midiTime, bool midiSense);
   double getMessage(std::vector<unsigned char> *message);
@@ -550,16 +766,33 @@ public:
         : bytes(0), timeStamp(0.0) {}
   };
 
+  // A message waiting in the queue. Channel and system messages are
+  // kept inline; anything longer (sysex) is copied into the queue's
+  // byte pool, which is allocated along with the ring, so a push
+  // never allocates.
+  struct QueuedMessage
+  {
+    unsigned char data[3];
+    unsigned int size;
+    unsigned int offset; // into MidiQueue::pool when size > 3
+    double timeStamp;
+  };
+
   struct MidiQueue
   {
     unsigned int front;
     unsigned int back;
     unsigned int ringSize;
-    MidiMessage *ring;
+    QueuedMessage *ring;
+    unsigned char *pool;
+    unsigned int poolSize;
+    unsigned int poolFront; // first pool byte in use, moved by pop()
+    unsigned int poolBack;  // next free pool byte, moved by push()
 
     // Default constructor.
     MidiQueue()
-        : front(0), back(0), ringSize(0), ring(0) {}
+        : front(0), back(0), ringSize(0), ring(0), pool(0), poolSize(0),
+          poolFront(0), poolBack(0) {}
     bool push(const MidiMessage &);
     bool pop(std::vector<unsigned char> *, double *);
     unsigned int size(unsigned int *back = 0, unsigned int *front = 0);
@@ -578,12 +811,18 @@ public:
     bool usingCallback;
     RtMidiIn::RtMidiCallback userCallback;
     void *userData;
+    RtMidiIn::RtMidiSpanCallback spanCallback;   // when set, userCallback
+    void *spanUserData;                          // adapts to it for the APIs
+    RtMidiIn::RtMidiBatchCallback batchCallback; // that only fill a vector,
+    void *batchUserData;                         // and spanCallback to this
     bool continueSysex;
+    MidiInApi *api; // whose error() the input thread reports through
 
     // Default constructor.
     RtMidiInData()
         : ignoreFlags(7), doInput(false), firstMessage(true), apiData(0), usingCallback(false),
-          userCallback(0), userData(0), continueSysex(false) {}
+          userCallback(0), userData(0), spanCallback(0), spanUserData(0), batchCallback(0),
+          batchUserData(0), continueSysex(false), api(0) {}
   };
 
 protected:
@@ -610,6 +849,8 @@ inline void RtMidiIn ::openVirtualPort(const std::string &portName) { rtapi_->op
 inline void RtMidiIn ::closePort(void) { rtapi_->closePort(); }
 inline bool RtMidiIn ::isPortOpen() const { return rtapi_->isPortOpen(); }
 inline void RtMidiIn ::setCallback(RtMidiCallback callback, void *userData) { static_cast<MidiInApi *>(rtapi_)->setCallback(callback, userData); }
+inline void RtMidiIn ::setSpanCallback(RtMidiSpanCallback callback, void *userData) { static_cast<MidiInApi *>(rtapi_)->setSpanCallback(callback, userData); }
+inline void RtMidiIn ::setBatchCallback(RtMidiBatchCallback callback, void *userData) { static_cast<MidiInApi *>(rtapi_)->setBatchCallback(callback, userData); }
 inline void RtMidiIn ::cancelCallback(void) { static_cast<MidiInApi *>(rtapi_)->cancelCallback(); }
 inline unsigned int RtMidiIn ::getPortCount(void) { return rtapi_->getPortCount(); }
 inline std::string RtMidiIn ::getPortName(unsigned int portNumber) { return rtapi_->getPortName(portNumber); }
@@ -0,0 +1,206 @@
+/*******************************************************************
+txsex_bench: ns/event through onMIDI() for the translation hot path.
+
+Links the engine and profiles only, no RtMidi or ALSA. The outputs are
+counting sinks with unlimited link room, so what is measured is the
+translation itself (ENGINE_MUTEX included), not any queue or wire.
+
+  txsex_bench [-n events] [-runs r] [-cpu n] [-json file]
+
+Each case gets a warmup pass, then r timed passes of n events; the table
+shows the best and the median pass, JSON follows it (or goes to file).
+*****************************************************************/
+#include "../engine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <sched.h>
+using namespace std;
+
+// One output per profile under test
+struct SINK {
+  SYNTH *synth = 0;
+  unsigned long messages = 0, bytes = 0;
+};
+static vector<SINK *> SINKS;
+
+static void sinkEmit(void *ctx, const unsigned char *message, size_t size) {
+  SINK *S = static_cast<SINK *>(ctx);
+  S->messages++;
+  S->bytes += size + message[0]; // touch the bytes
+}
+
+void sendMessage(const unsigned char *message, size_t size) {
+  for (size_t i = 0; i < SINKS.size(); i++)
+    sinkEmit(SINKS[i], message, size);
+}
+int outputCount() { return SINKS.size(); }
+void outputPanic(int /*output*/, int /*channel*/) {}
+SYNTH *outputSynth(int output) { return SINKS[output]->synth; }
+bool outputHasRoom(int /*output*/, int /*bytes*/) { return true; }
+long long getMicros() {
+  return chrono::duration_cast<chrono::microseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The stock maps have no MACRO entries, so the macro case runs on a
+// copy of the profile with CC 16 remapped to the carrier attack macro.
+const int MACRO_CC = 16;
+template <class P> struct WITH_MACRO : P {
+  static const CC_MAPPING *MAP; // set up in main(), after P::MAP exists
+  static vector<CC_MAPPING> table;
+  static void build() {
+    table.assign(P::MAP, P::MAP + 128);
+    table[MACRO_CC] = CC_MAPPING(MACRO, MACRO_CC, 0, P::ALGO_COUNT - 1, 0, 0);
+    MAP = table.data();
+  }
+};
+template <class P> const CC_MAPPING *WITH_MACRO<P>::MAP = 0;
+template <class P> vector<CC_MAPPING> WITH_MACRO<P>::table;
+
+// Fills message with event i of a case
+typedef void (*GENERATOR)(vector<unsigned char> &message, unsigned long i);
+
+static void notes(vector<unsigned char> &m, unsigned long i) {
+  m[0] = 0x90;
+  m[1] = 36 + (i >> 1) % 48;
+  m[2] = (i & 1) ? 0 : 100; // on, off, on, ...
+}
+static void ccPass(vector<unsigned char> &m, unsigned long i) {
+  m[0] = 0xB0;
+  m[1] = 7; // volume, a plain CC on both profiles
+  m[2] = i % 128;
+}
+static void sysex(vector<unsigned char> &m, unsigned long i) {
+  m[0] = 0xB0;
+  m[1] = 111; // a 0-99 parameter on both profiles
+  m[2] = (i & 1) ? 0 : 127;
+}
+static void macro(vector<unsigned char> &m, unsigned long i) {
+  m[0] = 0xB0;
+  m[1] = MACRO_CC;
+  m[2] = (i & 1) ? 0 : 127;
+}
+static void dedup(vector<unsigned char> &m, unsigned long /*i*/) {
+  m[0] = 0xB0;
+  m[1] = 111;
+  m[2] = 64; // the same value every time
+}
+
+struct CASE {
+  const char *name;
+  GENERATOR generate;
+};
+const CASE CASES[] = {
+  { "note_passthrough", notes }, { "cc_passthrough", ccPass },
+  { "sysex_translate", sysex },  { "macro_expand", macro },
+  { "dedup_hit", dedup },
+};
+
+struct RESULT {
+  string profile, name;
+  double best, median;
+  double out; // messages emitted per event
+};
+
+static double pass(GENERATOR generate, unsigned long n,
+                   vector<unsigned char> &message) {
+  auto start = chrono::steady_clock::now();
+  for (unsigned long i = 0; i < n; i++) {
+    generate(message, i);
+    onMIDI(0, &message, 0);
+  }
+  auto took = chrono::steady_clock::now() - start;
+  return chrono::duration_cast<chrono::nanoseconds>(took).count() / (double)n;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long n = 1000000;
+  int runs = 5, cpu = 0;
+  string jsonPath;
+  for (int i = 1; i < argc; i++) {
+    string cmd(argv[i]);
+    if (cmd == "-n" && i + 1 < argc) n = max(1L, atol(argv[++i]));
+    else if (cmd == "-runs" && i + 1 < argc) runs = max(1, atoi(argv[++i]));
+    else if (cmd == "-cpu" && i + 1 < argc) cpu = atoi(argv[++i]);
+    else if (cmd == "-json" && i + 1 < argc) jsonPath = argv[++i];
+    else {
+      cout << "Usage: txsex_bench [-n events] [-runs r] [-cpu n] [-json file]"
+           << endl;
+      return 1;
+    }
+  }
+
+  // Fixed affinity so runs are comparable, -cpu -1 leaves it alone.
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+      cout << "txsex_bench => could not pin to cpu " << cpu << endl;
+  }
+
+  WITH_MACRO<TX81Z>::build();
+  WITH_MACRO<DX7>::build();
+  const char *profiles[] = { TX81Z::NAME, DX7::NAME };
+  vector<RESULT> results;
+  vector<unsigned char> message(3);
+  for (int p = 0; p < 2; p++) {
+    SINK S;
+    if (p == 0) S.synth = new SYNTH_ENGINE<WITH_MACRO<TX81Z>>(sinkEmit, &S);
+    else S.synth = new SYNTH_ENGINE<WITH_MACRO<DX7>>(sinkEmit, &S);
+    SINKS.assign(1, &S);
+    for (size_t c = 0; c < sizeof(CASES) / sizeof(CASES[0]); c++) {
+      pass(CASES[c].generate, max(n / 10, 1000UL), message); // warmup
+      vector<double> times;
+      unsigned long before = S.messages;
+      for (int r = 0; r < runs; r++)
+        times.push_back(pass(CASES[c].generate, n, message));
+      sort(times.begin(), times.end());
+      RESULT R;
+      R.profile = profiles[p];
+      R.name = CASES[c].name;
+      R.best = times.front();
+      R.median = times[times.size() / 2];
+      R.out = (S.messages - before) / ((double)n * runs);
+      results.push_back(R);
+    }
+    SINKS.clear();
+    delete S.synth;
+  }
+
+  cout << left << setw(8) << "profile" << setw(20) << "case" << right
+       << setw(12) << "best ns" << setw(12) << "median ns" << setw(12)
+       << "out/event" << endl;
+  for (size_t i = 0; i < results.size(); i++) {
+    const RESULT &R = results[i];
+    cout << left << setw(8) << R.profile << setw(20) << R.name << right
+         << fixed << setprecision(1) << setw(12) << R.best << setw(12)
+         << R.median << setprecision(2) << setw(12) << R.out << endl;
+  }
+
+  ostringstream json;
+  json << "{\"events\":" << n << ",\"runs\":" << runs << ",\"cpu\":" << cpu
+       << ",\"results\":[";
+  for (size_t i = 0; i < results.size(); i++) {
+    const RESULT &R = results[i];
+    json << (i ? "," : "") << "{\"profile\":\"" << R.profile
+         << "\",\"case\":\"" << R.name << "\",\"best_ns\":" << R.best
+         << ",\"median_ns\":" << R.median << ",\"out_per_event\":" << R.out
+         << "}";
+  }
+  json << "]}";
+  if (jsonPath.empty()) {
+    cout << json.str() << endl;
+  } else {
+    ofstream out(jsonPath.c_str());
+    out << json.str() << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,172 @@
+/*******************************************************************
+Capture and replay for txsex. See capture.h.
+*****************************************************************/
+#include "capture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+const char CAPTURE_MAGIC[8] = { 'T', 'X', 'C', 'A', 'P', '1', '\n', 0 };
+const size_t CAPTURE_RING = 1 << 20; // bytes, a power of two
+const int CAPTURE_FLUSH_MS = 100;
+
+static size_t varint(unsigned char *out, unsigned long long value) {
+  size_t n = 0;
+  do {
+    out[n] = value & 0x7F;
+    value >>= 7;
+    if (value) out[n] |= 0x80;
+    n++;
+  } while (value);
+  return n;
+}
+
+bool CAPTURE::open(const string &path) {
+  file = fopen(path.c_str(), "wb");
+  if (!file) {
+    cout << "txsex => Could not create capture " << path << endl;
+    return false;
+  }
+  fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), file);
+  ring.resize(CAPTURE_RING);
+  run = true;
+  thread = std::thread(&CAPTURE::writer, this);
+  cout << "txsex => Capturing input to: " << path << endl;
+  return true;
+}
+
+// Copies into the ring at byte position 'at', wrapping. Returns the new position.
+size_t CAPTURE::put(size_t at, const unsigned char *data, size_t size) {
+  size_t i = at & (CAPTURE_RING - 1);
+  size_t first = min(size, CAPTURE_RING - i);
+  memcpy(&ring[i], data, first);
+  memcpy(&ring[0], data + first, size - first);
+  return at + size;
+}
+
+void CAPTURE::record(long long us, int source, const unsigned char *data,
+                     size_t size) {
+  if (!file) return;
+  unsigned char hdr[24];
+  if (last < 0) last = us;
+  size_t n = varint(hdr, us > last ? us - last : 0);
+  hdr[n++] = (unsigned char)source;
+  n += varint(hdr + n, size);
+
+  size_t h = head.load(std::memory_order_relaxed);
+  size_t t = tail.load(std::memory_order_acquire);
+  if (CAPTURE_RING - (h - t) < n + size) {
+    dropped++;
+    return;
+  }
+  if (us > last) last = us;
+  h = put(h, hdr, n);
+  h = put(h, data, size);
+  head.store(h, std::memory_order_release);
+  records++;
+  // Past half full, do not wait for the writer's next round.
+  if (h - t > CAPTURE_RING / 2 && h - t - n - size <= CAPTURE_RING / 2)
+    wake.notify_one();
+}
+
+void CAPTURE::writer() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(lock);
+      wake.wait_for(lk, std::chrono::milliseconds(CAPTURE_FLUSH_MS),
+                    [this] { return !run; });
+    }
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    while (t != h) { // at most two pieces, either side of the wrap
+      size_t i = t & (CAPTURE_RING - 1);
+      size_t n = min(h - t, CAPTURE_RING - i);
+      fwrite(&ring[i], 1, n, file);
+      t += n;
+    }
+    tail.store(t, std::memory_order_release);
+    fflush(file);
+    std::lock_guard<std::mutex> lk(lock);
+    if (!run) return;
+  }
+}
+
+void CAPTURE::close() {
+  if (!file) return;
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    run = false;
+  }
+  wake.notify_one();
+  if (thread.joinable()) thread.join();
+  fclose(file);
+  file = 0;
+  cout << "txsex => Captured " << records << " events";
+  if (dropped) cout << ", dropped " << dropped << " (disk too slow)";
+  cout << endl;
+}
+
+bool REPLAY::open(const string &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    cout << "txsex => Could not open capture " << path << endl;
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+  mapSize = st.st_size;
+  void *mem = mapSize >= sizeof(CAPTURE_MAGIC)
+                  ? mmap(0, mapSize, PROT_READ, MAP_PRIVATE, fd, 0)
+                  : MAP_FAILED;
+  ::close(fd);
+  if (mem == MAP_FAILED ||
+      memcmp(mem, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+    cout << "txsex => " << path << " is not a txsex capture" << endl;
+    if (mem != MAP_FAILED) munmap(mem, mapSize);
+    mapSize = 0;
+    return false;
+  }
+  map = static_cast<const unsigned char *>(mem);
+  madvise((void *)map, mapSize, MADV_SEQUENTIAL);
+  p = map + sizeof(CAPTURE_MAGIC);
+  end = map + mapSize;
+  us = 0;
+  return true;
+}
+
+void REPLAY::close() {
+  if (map) munmap((void *)map, mapSize);
+  map = p = end = 0;
+  mapSize = 0;
+}
+
+static bool readVarint(const unsigned char *&p, const unsigned char *end,
+                       unsigned long long &value) {
+  value = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    unsigned char b = *p++;
+    value |= (unsigned long long)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+bool REPLAY::next(long long &at, int &source, vector<unsigned char> &bytes) {
+  unsigned long long delta, size;
+  if (!readVarint(p, end, delta) || p >= end) return false;
+  source = *p++;
+  if (!readVarint(p, end, size) || size > (size_t)(end - p))
+    return false; // a capture cut short ends at its last whole record
+  bytes.assign(p, p + size);
+  p += size;
+  us += delta;
+  at = us;
+  return true;
+}
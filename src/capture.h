@@ -0,0 +1,68 @@
+/*******************************************************************
+Capture and replay of what the translator is fed.
+
+-capture <file> logs every event the merge thread hands to onMIDI():
+when it was stamped, which input it came from and its bytes. The merge
+thread only copies the event into a memory ring; a background thread
+writes the ring out, so a slow disk costs dropped records, never
+latency. -replay <file> feeds a capture back through onMIDI() with the
+original timing, or as fast as possible with -fast.
+
+File layout: the 8 byte magic "TXCAP1\n\0", then one record per event:
+  varint  microseconds since the previous record
+  byte    source, the input index (0 is TXCC, then -i/-vi in order)
+  varint  length
+  bytes   the message
+Varints are 7 bits per byte, low group first, high bit set on all but
+the last byte.
+*****************************************************************/
+#ifndef TXSEX_CAPTURE_H
+#define TXSEX_CAPTURE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CAPTURE {
+public:
+  ~CAPTURE() { close(); }
+  bool open(const std::string &path);
+  // Merge thread only. Drops the record if the ring is full.
+  void record(long long us, int source, const unsigned char *data, size_t size);
+  void close(); // writes out what is left
+
+  unsigned long records = 0, dropped = 0; // producer side counters
+
+private:
+  void writer();
+  size_t put(size_t at, const unsigned char *data, size_t size);
+
+  FILE *file = 0;
+  std::vector<unsigned char> ring;
+  std::atomic<size_t> head{0}, tail{0}; // byte positions, free running
+  long long last = -1;
+  bool run = false;
+  std::mutex lock; // only for the writer's sleep
+  std::condition_variable wake;
+  std::thread thread;
+};
+
+class REPLAY {
+public:
+  ~REPLAY() { close(); }
+  bool open(const std::string &path);
+  void close();
+  // us is microseconds since the first record
+  bool next(long long &us, int &source, std::vector<unsigned char> &bytes);
+
+private:
+  const unsigned char *map = 0, *p = 0, *end = 0;
+  size_t mapSize = 0;
+  long long us = 0;
+};
+
+#endif
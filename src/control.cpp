@@ -0,0 +1,258 @@
+/*******************************************************************
+Control socket and shared memory ring for txsex. See control.h.
+*****************************************************************/
+#include "control.h"
+#include "log.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+struct CLIENT {
+  int fd;
+  string pending; // bytes received after the last full line
+};
+
+static int listenFd = -1;
+static string socketPath;
+static vector<CLIENT> clients;
+static CONTROL_RING *ring = 0;
+static string ringName;
+static std::atomic<bool> controlRun(false);
+static std::thread controlThread;
+
+static void controlWorker();
+
+static bool openSocket(const string &path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    cout << "txsex => Control socket path too long: " << path << endl;
+    return false;
+  }
+  strcpy(addr.sun_path, path.c_str());
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0) return false;
+  unlink(path.c_str()); // left behind by a previous run
+  if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listenFd, 4) < 0) {
+    cout << "txsex => Could not listen on " << path << ": "
+         << strerror(errno) << endl;
+    close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+  socketPath = path;
+  cout << "txsex => Control socket: " << path << endl;
+  return true;
+}
+
+static bool openRing(const string &name) {
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+  if (fd < 0 || ftruncate(fd, sizeof(CONTROL_RING)) < 0) {
+    cout << "txsex => Could not create shared memory " << name << ": "
+         << strerror(errno) << endl;
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  void *mem = mmap(0, sizeof(CONTROL_RING), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) return false;
+  ring = static_cast<CONTROL_RING *>(mem);
+  // Start empty even if a previous run left events behind.
+  ring->magic = 0;
+  ring->slots = CONTROL_RING_SLOTS;
+  ring->head.store(0);
+  ring->tail.store(0);
+  std::atomic_thread_fence(std::memory_order_release);
+  ring->magic = CONTROL_RING_MAGIC;
+  ringName = name;
+  cout << "txsex => Control ring: " << name << " (" << CONTROL_RING_SLOTS
+       << " events)" << endl;
+  return true;
+}
+
+bool startControl(const string &path, const string &shm) {
+  if (!path.empty() && !openSocket(path)) return false;
+  if (!shm.empty() && !openRing(shm)) return false;
+  if (listenFd < 0 && !ring) return true;
+  controlRun = true;
+  controlThread = std::thread(controlWorker);
+  return true;
+}
+
+void stopControl() {
+  controlRun = false;
+  if (controlThread.joinable()) controlThread.join();
+  for (size_t i = 0; i < clients.size(); i++) close(clients[i].fd);
+  clients.clear();
+  if (listenFd >= 0) {
+    close(listenFd);
+    unlink(socketPath.c_str());
+    listenFd = -1;
+  }
+  if (ring) {
+    munmap(ring, sizeof(CONTROL_RING));
+    shm_unlink(ringName.c_str());
+    ring = 0;
+  }
+}
+
+static void reply(int fd, const string &text) {
+  size_t done = 0;
+  while (done < text.size()) {
+    ssize_t n = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+    if (n <= 0) return; // the client went away, poll() will tell us
+    done += n;
+  }
+}
+
+// Every F0 .. F7 message in a .syx file
+static bool readSyx(const string &path, vector<vector<unsigned char>> &dump) {
+  ifstream in(path.c_str(), ios::binary);
+  if (!in) return false;
+  vector<unsigned char> message;
+  char c;
+  while (in.get(c)) {
+    unsigned char b = (unsigned char)c;
+    if (b == 0xF0) message.clear();
+    message.push_back(b);
+    if (b == 0xF7 && message[0] == 0xF0) dump.push_back(message);
+  }
+  return !dump.empty();
+}
+
+static string execute(const string &line) {
+  istringstream in(line);
+  string cmd;
+  in >> cmd;
+  if (cmd.empty()) return "";
+
+  if (cmd == "set") {
+    int cc = -1, value = -1, range = 127, port = -1;
+    in >> cc >> value;
+    if (in.fail() || cc < 0 || cc > 127 || value < 0)
+      return "error usage: set <cc> <value> [<range> [<port>]]\n";
+    if (in >> range) in >> port;
+    if (range < 1 || value > range) return "error value out of range\n";
+    if (!controlCC(port, 0xB0, cc, value, range)) return "error no such port\n";
+    return "ok\n";
+  }
+  if (cmd == "voice") {
+    string path;
+    int port = -1;
+    in >> path >> port;
+    vector<vector<unsigned char>> dump;
+    if (path.empty() || !readSyx(path, dump))
+      return "error no sysex in " + path + "\n";
+    int n = controlVoice(port, dump);
+    if (n < 0) return "error no such port\n";
+    if (n == 0) return "error no output takes this dump\n";
+    return "ok " + to_string(n) + "\n";
+  }
+  if (cmd == "send") {
+    int port = -1;
+    in >> port;
+    if (!controlSend(port)) return "error no such port\n";
+    return "ok\n";
+  }
+  if (cmd == "panic") {
+    int port = -1;
+    in >> port;
+    if (!controlPanic(port)) return "error no such port\n";
+    return "ok\n";
+  }
+  if (cmd == "log") {
+    string level;
+    in >> level;
+    if (!level.empty() && !setLogLevel(level))
+      return "error log level is error, warn, info or debug\n";
+    return string("ok ") + logLevelName() + "\n";
+  }
+  if (cmd == "stats") {
+    ostringstream out;
+    printStats(out);
+    return out.str() + "ok\n";
+  }
+  return "error unknown command " + cmd + "\n";
+}
+
+static void drainRing() {
+  uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint32_t head = ring->head.load(std::memory_order_acquire);
+  if (head - tail > CONTROL_RING_SLOTS) { // producer ignored a full ring
+    logMessage(LOG_WARN, "txsex => Control ring overrun, skipping %u events",
+               head - tail);
+    ring->tail.store(head, std::memory_order_release);
+    return;
+  }
+  for (; tail != head; tail++) {
+    // A copy, checked field by field: the other process is not trusted
+    CONTROL_EVENT E = ring->events[tail % CONTROL_RING_SLOTS];
+    int status = E.status ? E.status : 0xB0;
+    int range = E.range ? E.range : 127;
+    if ((status & 0xF0) != 0xB0 || E.cc > 127 || E.value > range ||
+        !controlCC(E.port, status, E.cc, E.value, range))
+      logMessage(LOG_WARN,
+                 "txsex => Control ring event skipped: port %d status %d cc "
+                 "%d value %d range %d",
+                 E.port, E.status, E.cc, E.value, E.range);
+  }
+  ring->tail.store(tail, std::memory_order_release);
+}
+
+static void controlWorker() {
+  vector<pollfd> fds;
+  char buf[512];
+  while (controlRun) {
+    fds.clear();
+    if (listenFd >= 0) fds.push_back({ listenFd, POLLIN, 0 });
+    for (size_t i = 0; i < clients.size(); i++)
+      fds.push_back({ clients[i].fd, POLLIN, 0 });
+    // With a ring to watch wake every millisecond, else just often
+    // enough to notice stopControl().
+    poll(fds.data(), fds.size(), ring ? 1 : 100);
+
+    if (ring) drainRing();
+
+    size_t first = 0;
+    if (listenFd >= 0) {
+      first = 1;
+      if (fds[0].revents & POLLIN) {
+        int fd = accept(listenFd, 0, 0);
+        if (fd >= 0) clients.push_back({ fd, "" });
+      }
+    }
+    // Walk backwards so closed clients can be erased in place.
+    for (size_t i = fds.size(); i-- > first;) {
+      if (!fds[i].revents) continue;
+      CLIENT &C = clients[i - first];
+      ssize_t n = recv(C.fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+        close(C.fd);
+        clients.erase(clients.begin() + (i - first));
+        continue;
+      }
+      C.pending.append(buf, n);
+      size_t eol;
+      while ((eol = C.pending.find('\n')) != string::npos) {
+        string line = C.pending.substr(0, eol);
+        C.pending.erase(0, eol + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        reply(C.fd, execute(line));
+      }
+      if (C.pending.size() > 4096) C.pending.clear(); // not a line protocol
+    }
+  }
+}
@@ -0,0 +1,82 @@
+/*******************************************************************
+Local control plane for txsex, for editors and scripts running on the
+same box (NoderServer, a shell script, ...).
+
+-ctl <path> listens on a UNIX stream socket. Commands are one per line,
+every reply ends with a line "ok" or "error <reason>":
+  set <cc> <value> [<range> [<port>]]  as if CC <cc> had arrived, with
+                                       value 0..range (default 127)
+  voice <file.syx> [<port>]            load a bulk dump and send it
+  send [<port>]                        resend the current voice image
+  panic [<port>]                       note-offs for every sounding note
+  stats                                queue statistics
+  log [<level>]                        set the log level (error, warn,
+                                       info, debug), replies the current
+<port> is the output index in -p order (0 is the first), default all.
+
+-shm <name> creates a POSIX shared memory ring (shm_open name, eg /txsex)
+for one producer process. It writes CONTROL_EVENTs at events[head %
+slots] and then bumps head; txsex reads from tail. The producer must not
+write while head - tail == slots, as txsex may still be reading the slot:
+controlRingPush() below does this. Events go through the same
+translation and dedup as the socket "set" command, and one with a field
+out of range is skipped.
+*****************************************************************/
+#ifndef TXSEX_CONTROL_H
+#define TXSEX_CONTROL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+const uint32_t CONTROL_RING_MAGIC = 0x54585231; // "TXR1"
+const uint32_t CONTROL_RING_SLOTS = 1024;       // power of two
+
+struct CONTROL_EVENT {
+  int16_t port;   // output index, -1 for all
+  uint8_t status; // 0xB0 | channel, kept by pass-through CCs
+  uint8_t cc;
+  uint16_t value; // 0..range
+  uint16_t range; // 0 means 127
+};
+
+struct CONTROL_RING {
+  uint32_t magic; // written last, once the ring is ready
+  uint32_t slots;
+  alignas(64) std::atomic<uint32_t> head; // producer only
+  alignas(64) std::atomic<uint32_t> tail; // txsex only
+  alignas(64) CONTROL_EVENT events[CONTROL_RING_SLOTS];
+};
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "ring indices must be plain words in shared memory");
+
+// For the producer: queues one event, false (writing nothing) while
+// the ring is full.
+inline bool controlRingPush(CONTROL_RING *ring, const CONTROL_EVENT &event) {
+  uint32_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= CONTROL_RING_SLOTS)
+    return false;
+  ring->events[head % CONTROL_RING_SLOTS] = event;
+  ring->head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+// Either name may be empty. False if what was asked for could not be set up.
+bool startControl(const std::string &path, const std::string &shm);
+void stopControl();
+
+// Provided by main.cpp, called from the control thread. port -1 is all
+// outputs. They return false for a port index that does not exist, or
+// is below -1.
+bool controlCC(int port, unsigned char status, int cc, int value, int range);
+// Loads every message of the dump each port's profile understands and
+// sends the voice to those ports. Returns how many ports took it.
+int controlVoice(int port, const std::vector<std::vector<unsigned char>> &dump);
+bool controlSend(int port);
+bool controlPanic(int port);
+void printStats(std::ostream &out);
+
+#endif
@@ -0,0 +1,179 @@
+/*******************************************************************
+Translation core for txsex. See engine.h.
+*****************************************************************/
+#include "engine.h"
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+std::mutex ENGINE_MUTEX;
+vector<MOD_ROUTE> MODS;
+
+// --- onMIDI() dispatch: one entry per status byte ---
+// Each handler gets the whole message as a pointer and length, with
+// ENGINE_MUTEX held. Notes, pitch bend and the other channel messages
+// go out as they came in (no filters or "Echo Killers", so no added
+// latency), modulation is derived only after the note itself has gone
+// out, and CCs are translated by each output's own synth profile.
+typedef void (*HANDLER)(const unsigned char *message, size_t size);
+struct STATUS_HANDLER {
+  HANDLER handle;
+  size_t size; // bytes in a whole message, the least for sysex
+};
+
+static void drop(const unsigned char *, size_t) {}
+static void passThrough(const unsigned char *message, size_t size) {
+  sendMessage(message, size);
+}
+static void noteOn(const unsigned char *message, size_t size) {
+  sendMessage(message, size);
+  if (message[2] > 0) onModSource(VELOCITY, message[2]);
+}
+static void polyPressure(const unsigned char *message, size_t size) {
+  sendMessage(message, size);
+  onModSource(POLYAT, message[2]);
+}
+static void control(const unsigned char *message, size_t) {
+  onControl(-1, message[0], message[1], message[2], 127);
+}
+static void chanPressure(const unsigned char *message, size_t size) {
+  sendMessage(message, size);
+  onModSource(CHANPRESS, message[1]);
+}
+
+#define ROW(handle, size)                                                     \
+  { handle, size }, { handle, size }, { handle, size }, { handle, size },     \
+  { handle, size }, { handle, size }, { handle, size }, { handle, size },     \
+  { handle, size }, { handle, size }, { handle, size }, { handle, size },     \
+  { handle, size }, { handle, size }, { handle, size }, { handle, size }
+static constexpr STATUS_HANDLER DISPATCH[256] = {
+  // 0x00-0x7F: data bytes, not a message
+  ROW(drop, 1), ROW(drop, 1), ROW(drop, 1), ROW(drop, 1),
+  ROW(drop, 1), ROW(drop, 1), ROW(drop, 1), ROW(drop, 1),
+  ROW(passThrough, 3),  // 0x8n note off
+  ROW(noteOn, 3),       // 0x9n note on
+  ROW(polyPressure, 3), // 0xAn poly aftertouch
+  ROW(control, 3),      // 0xBn control change
+  ROW(passThrough, 2),  // 0xCn program change
+  ROW(chanPressure, 2), // 0xDn channel pressure
+  ROW(passThrough, 3),  // 0xEn pitch bend
+  { passThrough, 2 },   // 0xF0 sysex
+  { passThrough, 2 },   // 0xF1 MTC quarter frame
+  { passThrough, 3 },   // 0xF2 song position
+  { passThrough, 2 },   // 0xF3 song select
+  { drop, 1 },          // 0xF4 undefined
+  { drop, 1 },          // 0xF5 undefined
+  { passThrough, 1 },   // 0xF6 tune request
+  { drop, 1 },          // 0xF7 end of sysex on its own
+  { passThrough, 1 },   // 0xF8 clock
+  { drop, 1 },          // 0xF9 undefined
+  { passThrough, 1 },   // 0xFA start
+  { passThrough, 1 },   // 0xFB continue
+  { passThrough, 1 },   // 0xFC stop
+  { drop, 1 },          // 0xFD undefined
+  { drop, 1 },          // 0xFE active sensing, between us and our source
+  { passThrough, 1 },   // 0xFF reset
+};
+#undef ROW
+
+void onControl(int output, unsigned char status, int cc, int value, int range) {
+  for (int i = 0; i < outputCount(); i++) {
+    if (output >= 0 && i != output) continue;
+    // All sound off / all notes off: the note-offs themselves first, as
+    // not every synth acts on the CC
+    if (cc == 120 || cc == 123) outputPanic(i, status & 0x0F);
+    outputSynth(i)->control(status, cc, value, range);
+  }
+}
+
+void onMIDI(double /*deltatime*/, std::vector<unsigned char> *message, void * /*userData*/) {
+  if (message->empty()) return;
+  const STATUS_HANDLER &H = DISPATCH[message->front()];
+  if (message->size() < H.size) return;
+  std::lock_guard<std::mutex> lock(ENGINE_MUTEX);
+  H.handle(message->data(), message->size());
+}
+
+std::vector<unsigned char> inputStatuses() {
+  // Channel messages by their upper nibble, the rest as they are
+  std::vector<unsigned char> statuses;
+  for (int s = 0x80; s < 0x100; s += s < 0xF0 ? 0x10 : 1)
+    if (DISPATCH[s].handle != drop) statuses.push_back(s);
+  return statuses;
+}
+int limit(int v, int min, int max) {
+  if (v < min)
+    v = min;
+  if (v > max)
+    v = max;
+  return v;
+}
+
+
+bool addModRoute(string spec) {
+  // source:cc[:rate[:hysteresis]]
+  vector<string> f;
+  size_t start = 0, end;
+  while ((end = spec.find(':', start)) != string::npos) {
+    f.push_back(spec.substr(start, end - start));
+    start = end + 1;
+  }
+  f.push_back(spec.substr(start));
+  if (f.size() < 2 || f.size() > 4) return false;
+
+  MODSOURCES source;
+  if (f[0] == "vel") source = VELOCITY;
+  else if (f[0] == "cp") source = CHANPRESS;
+  else if (f[0] == "pat") source = POLYAT;
+  else return false;
+
+  int cc = atoi(f[1].c_str());
+  if (cc < 0 || cc > 119) {
+    cout << "txsex => -mod target CC " << f[1] << " is out of range" << endl;
+    return false;
+  }
+  MOD_ROUTE R(source, cc, 25, 1);
+  if (f.size() > 2) R.RATE = limit(atoi(f[2].c_str()), 1, 200);
+  if (f.size() > 3) R.HYST = limit(atoi(f[3].c_str()), 0, 127);
+  MODS.push_back(R);
+  cout << "txsex => Modulation: " << f[0] << " -> CC " << cc << " @ "
+       << R.RATE << "Hz, hysteresis " << R.HYST << endl;
+  return true;
+}
+
+void onModSource(MODSOURCES source, int value) {
+  long long now = 0;
+  for (size_t i = 0; i < MODS.size(); i++) {
+    MOD_ROUTE &R = MODS[i];
+    if (R.SOURCE != source) continue;
+    if (R.sent != -1 && abs(value - R.sent) < R.HYST) {
+      R.pending = -1; // settled back inside the dead band
+      continue;
+    }
+    R.pending = value;
+    if (now == 0) now = getMicros();
+    flushMod(R, now);
+  }
+}
+
+void flushMod(MOD_ROUTE &R, long long now) {
+  if (R.pending == -1) return;
+  if (now - R.lastUs < 1000000LL / R.RATE) return;
+  // A parameter change is 7 bytes on either profile.
+  for (int i = 0; i < outputCount(); i++)
+    if (!outputHasRoom(i, 7)) return;
+
+  unsigned char msg[3] = { 0xB0, (unsigned char)R.CC, (unsigned char)R.pending };
+  for (int i = 0; i < outputCount(); i++)
+    outputSynth(i)->onCC(msg);
+  R.sent = R.pending;
+  R.pending = -1;
+  R.lastUs = now;
+}
+
+void serviceMods() {
+  if (MODS.empty()) return;
+  std::lock_guard<std::mutex> lock(ENGINE_MUTEX);
+  long long now = getMicros();
+  for (size_t i = 0; i < MODS.size(); i++) flushMod(MODS[i], now);
+}
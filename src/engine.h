@@ -0,0 +1,58 @@
+/*******************************************************************
+The translation core of txsex: onMIDI() and the modulation matrix,
+with no MIDI I/O of its own. Whoever links it (txsex itself, the
+benchmark) provides the outputs through the functions at the bottom.
+*****************************************************************/
+#ifndef TXSEX_ENGINE_H
+#define TXSEX_ENGINE_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include "synth.h"
+
+// onMIDI() runs on the input merge thread while modulation flushes run
+// from the main loop, so both hold this around the translation state.
+extern std::mutex ENGINE_MUTEX;
+
+// Modulation matrix: performance data (velocity / aftertouch) moving a
+// mapped CC on every output, as if the knob had been turned. Routes are
+// added with -mod on the command line.
+enum MODSOURCES { VELOCITY, CHANPRESS, POLYAT };
+
+struct MOD_ROUTE {
+  MOD_ROUTE(MODSOURCES SOURCE, int CC, int RATE, int HYST)
+      : SOURCE(SOURCE), CC(CC), RATE(RATE), HYST(HYST) {};
+  MODSOURCES SOURCE = VELOCITY;
+  int CC = 0;    // target CC, translated by each output's profile
+  int RATE = 25; // max updates per second
+  int HYST = 1;  // minimum change (in 7 bit source steps) worth sending
+  int sent = -1;
+  int pending = -1;
+  long long lastUs = 0;
+};
+extern std::vector<MOD_ROUTE> MODS;
+bool addModRoute(std::string spec);
+void onModSource(MODSOURCES source, int value);
+void flushMod(MOD_ROUTE &R, long long now);
+void serviceMods();
+
+void onMIDI(double deltatime, std::vector<unsigned char> *message, void *userData);
+// A CC to one output (or every one when output is -1) the way onMIDI()
+// handles it, with the value out of 0..range. ENGINE_MUTEX held.
+void onControl(int output, unsigned char status, int cc, int value, int range);
+// The status bytes onMIDI() does anything with, channel messages by
+// their upper nibble, read off its dispatch table. Inputs may drop
+// everything else before it.
+std::vector<unsigned char> inputStatuses();
+int limit(int val, int min, int max);
+
+// Provided by the program linking the engine.
+void sendMessage(const unsigned char *message, size_t size); // pass-through, every output
+int outputCount();
+void outputPanic(int output, int channel); // note-offs for what still sounds
+SYNTH *outputSynth(int output);
+bool outputHasRoom(int output, int bytes); // link credit for modulation
+long long getMicros();
+
+#endif
@@ -0,0 +1,216 @@
+/*******************************************************************
+Asynchronous logging for txsex. See log.h.
+*****************************************************************/
+#include "log.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+const int LOG_LINE = 192;          // bytes per line, longer ones are cut
+const unsigned int LOG_SLOTS = 64; // lines queued per thread
+const int LOG_RECENT = 8;          // lines per thread checked for repeats
+const int LOG_COUNT = 48;          // room kept for " (<n> repeats not shown)"
+const int LOG_WRITE_MS = 20;
+
+static const char *LEVEL_NAMES[] = { "error", "warn", "info", "debug" };
+static std::atomic<int> level{LOG_INFO};
+
+// One per thread that logs. Only that thread moves head and only the
+// writer moves tail. Rings stay until exit: a thread may be gone by the
+// time its last lines are written out.
+struct LOG_RING {
+  char lines[LOG_SLOTS][LOG_LINE];
+  std::atomic<unsigned int> head{0}, tail{0};
+  std::atomic<unsigned long> lost{0}; // lines that found the ring full
+  unsigned long reported = 0;         // of those, written out as lost
+  // Guards recent. The thread only ever tries it: while the writer is
+  // collecting counts, its lines go out without repeat suppression.
+  std::mutex recentLock;
+  struct RECENT {
+    uint32_t hash = 0;
+    long long us = 0;           // when it was last queued
+    unsigned long repeats = 0;  // copies counted since
+    char line[LOG_LINE];        // as first queued, for the count
+  } recent[LOG_RECENT];
+};
+
+static std::mutex ringsLock; // new threads, and the writer's snapshot
+static vector<LOG_RING *> rings;
+static thread_local LOG_RING *own = 0;
+static std::atomic<bool> running{false};
+static std::thread writer;
+
+static long long logMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static uint32_t logHash(const char *line) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (; *line; line++) h = (h ^ (unsigned char)*line) * 16777619u;
+  return h;
+}
+
+static LOG_RING *ownRing() {
+  if (!own) {
+    own = new LOG_RING();
+    std::lock_guard<std::mutex> lk(ringsLock);
+    rings.push_back(own);
+  }
+  return own;
+}
+
+static void writeRepeats(LOG_RING::RECENT &E, string &out) {
+  out += E.line;
+  out += " (" + to_string(E.repeats) + " repeats not shown)\n";
+  E.repeats = 0;
+}
+
+// Everything queued so far, in one write to cout, followed by the
+// counts of lines that stopped repeating (or all of them, at the end).
+static void writeRings(bool final) {
+  static vector<LOG_RING *> snapshot; // writer only
+  static string out;
+  {
+    std::lock_guard<std::mutex> lk(ringsLock);
+    snapshot = rings;
+  }
+  out.clear();
+  for (size_t i = 0; i < snapshot.size(); i++) {
+    LOG_RING *R = snapshot[i];
+    unsigned int tail = R->tail.load(std::memory_order_relaxed);
+    unsigned int head = R->head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+      out += R->lines[tail % LOG_SLOTS];
+      out += '\n';
+    }
+    R->tail.store(tail, std::memory_order_release);
+    unsigned long lost = R->lost.load(std::memory_order_relaxed);
+    if (lost != R->reported) {
+      out += "txsex => " + to_string(lost - R->reported) +
+             " log lines lost, the thread logged faster than they were written\n";
+      R->reported = lost;
+    }
+    long long now = logMicros();
+    std::lock_guard<std::mutex> lk(R->recentLock);
+    for (int e = 0; e < LOG_RECENT; e++) {
+      LOG_RING::RECENT &E = R->recent[e];
+      if (E.repeats && (final || now - E.us >= LOG_REPEAT_US))
+        writeRepeats(E, out);
+    }
+  }
+  if (!out.empty()) cout << out << flush;
+}
+
+static void writeLoop() {
+  while (running.load(std::memory_order_acquire)) {
+    writeRings(false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOG_WRITE_MS));
+  }
+}
+
+bool setLogLevel(const string &name) {
+  for (int i = LOG_ERROR; i <= LOG_DEBUG; i++)
+    if (name == LEVEL_NAMES[i]) {
+      level.store(i, std::memory_order_relaxed);
+      return true;
+    }
+  return false;
+}
+
+const char *logLevelName() {
+  return LEVEL_NAMES[level.load(std::memory_order_relaxed)];
+}
+
+bool logEnabled(LOG_LEVEL l) {
+  return l <= level.load(std::memory_order_relaxed);
+}
+
+void startLog() {
+  if (running.exchange(true)) return;
+  writer = std::thread(writeLoop);
+}
+
+void stopLog() {
+  if (!running.exchange(false)) return;
+  if (writer.joinable()) writer.join();
+  writeRings(true);
+}
+
+static void queueLine(LOG_RING *R, const char *line) {
+  unsigned int head = R->head.load(std::memory_order_relaxed);
+  if (head - R->tail.load(std::memory_order_acquire) == LOG_SLOTS) {
+    R->lost.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  memcpy(R->lines[head % LOG_SLOTS], line, strlen(line) + 1);
+  R->head.store(head + 1, std::memory_order_release);
+}
+
+void logMessage(LOG_LEVEL l, const char *format, ...) {
+  if (!logEnabled(l)) return;
+  char line[LOG_LINE];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (n < 0) return;
+  if (!running.load(std::memory_order_acquire)) {
+    cout << line << endl;
+    return;
+  }
+
+  // Count the line if it went out a moment ago, else queue it along
+  // with how many copies it stands for.
+  LOG_RING *R = ownRing();
+  if (!R->recentLock.try_lock()) {
+    queueLine(R, line);
+    return;
+  }
+  uint32_t h = logHash(line);
+  long long now = logMicros();
+  LOG_RING::RECENT *E = 0, *oldest = &R->recent[0];
+  for (int i = 0; i < LOG_RECENT; i++) {
+    if (R->recent[i].hash == h) {
+      E = &R->recent[i];
+      break;
+    }
+    if (R->recent[i].us < oldest->us) oldest = &R->recent[i];
+  }
+  if (E && now - E->us < LOG_REPEAT_US) {
+    E->repeats++;
+    R->recentLock.unlock();
+    return;
+  }
+  if (!E) { // the count of the line it replaces goes out first
+    E = oldest;
+    if (E->repeats) {
+      char count[LOG_LINE];
+      snprintf(count, sizeof(count), "%.*s (%lu repeats not shown)",
+               LOG_LINE - LOG_COUNT, E->line, E->repeats);
+      queueLine(R, count);
+    }
+    E->hash = h;
+    E->repeats = 0;
+    memcpy(E->line, line, strlen(line) + 1);
+  }
+  E->us = now;
+  if (E->repeats) {
+    size_t len = strlen(line);
+    snprintf(line + len, sizeof(line) - len, " (%lu repeats not shown)",
+             E->repeats);
+    E->repeats = 0;
+  }
+  R->recentLock.unlock();
+  queueLine(R, line);
+}
@@ -0,0 +1,36 @@
+/*******************************************************************
+Logging for the threads that must not wait on stdout.
+
+logMessage() formats a line into a ring owned by the calling thread,
+without locks, and a background thread started by startLog() writes
+every ring out to cout. Until startLog() and after stopLog() lines go
+to cout directly.
+
+A line a thread already logged less than LOG_REPEAT_US ago is counted
+instead of queued. The count goes out with the next copy that is, or
+on its own once LOG_REPEAT_US has passed since the copy before it, and
+at stopLog().
+Lines above the current level (-log-level, or "log <level>" on the
+control socket) are dropped before they are formatted.
+*****************************************************************/
+#ifndef TXSEX_LOG_H
+#define TXSEX_LOG_H
+
+#include <string>
+
+enum LOG_LEVEL { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG };
+
+const long long LOG_REPEAT_US = 1000000;
+
+// error, warn, info or debug. False for anything else.
+bool setLogLevel(const std::string &name);
+const char *logLevelName();
+bool logEnabled(LOG_LEVEL level);
+
+void startLog();
+void stopLog(); // writes out what is still queued
+
+void logMessage(LOG_LEVEL level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#endif
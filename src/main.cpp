@@ -3,609 +3,569 @@ TX81z CC to Sysex Translator for Akai Force/Raspberry PI forked from dxsex
 Original Author: Amit Talwar https://www.amitszone.com
 Github: https://github.com/intelliriffer
 *****************************************************************
-
-SYSTEM EXCLUSIVE DATA FORMAT
-The TX81Z has three types of System Exclusive message; Parameter Change
-messages, Bulk Data messages and Dump Request messages.
-
-PARAMETER CHANGE MESSAGES
-These messages change the value of a parameter in TX81Z memory. There are
-8 subgroups of Parameter Changes; VCED, ACED, PCED, Remote Switch,
-Micro Tuning, Program Change, Effect data and System data.
-
-VCED, ACED, PCED and Remote Switch parameter change messages have the
-following format.
-F0h        Exclusive
-43h        I.D. number (Yamaha)
-1nh        Basic receive channel
-0ggggghh   ggggg = Group number, hh = Subgroup number
-0ppppppp   ppppppp = Parameter number
-0ddddddd   ddddddd = Data
-F7h        End Of Exclusive
-
-* VCED (Voice parameters compatible with DX21/27/100)
-  ggggg = 00100 (4), hh = 10 (2)
-  See p.71 for parameter numbers and data.
-
-* ACED (Additional voice parameters for TX81Z)
-  ggggg = 00100 (4), hh = 11 (3)
-  See p.73 for parameter numbers and data.
-
-* PCED (Performance parameters)
-  ggggg = 00100 (4), hh = 11 (3)
-  See p.74 for parameter numbers and data.
-
-* Remote Switch (The same effect as pressing a switch on the TX81Z front
-  panel, i.e., 'remote control'.)
-  ggggg = 00100 (4), hh = 11 (3), ddddddd = 0 (off), 7F (on)
-  See p.75 for switch numbers.
-
-System Parameter Change (basic receive channel settings, etc.) and Effect
-Parameter Change (data for delay, pan and chord) messages have the following
-format.
-F0h        Exclusive
-43h        I.D. number (Yamaha)
-1nh        Basic receive channel
-0ggggghh   ggggg = 00100 (4), hh = 00 (0)
-0ppppppp   ppppppp = 1111011 (123) = System Parameter
-           ppppppp = 1111100 (124) = Effect Parameter
-0kkkkkkk   kkkkkkk = Parameter number
-
-Micro Tune parameter change messages have the following format.
-F0h        Exclusive
-43h        I.D. number (Yamaha)
-1nh        Basic receive channel
-0ggggghh   ggggg = 00100 (4), hh = 00
-0ppppppp   ppppppp = 1111101 (125) OCT
-           ppppppp = 1111110 (126) FULL
-0kkkkkkk   kkkkkkk = key number
-0hhhhhhh   hhhhhhh = note C#-1 to C7 (13-108)
-           = data fine tuning 0 to +31, -31 to -1 (0-32, 33-63)
-F7h        End Of Exclusive
-
-Program Change Table parameter change messages have the following format.
-The data is 0-184d, indicating the TX81Z memory to be selected in response to
-the incoming program change number. 0-31 (I1-I32), 32-63 (A1-A32), 64-95
-(B1-B32), 96-127 (C1-C32), 128-160 (D1-D32), 161-184 (PF1-PF24)
-
-F0h        Exclusive
-43h        I.D. number (Yamaha)
-1nh        Basic receive channel
-0ggggghh   ggggg = 00100 (4), hh = 00
-0ppppppp   ppppppp = 1111111 (127)
-0kkkkkkk   kkkkkkk = program change number
-0hhhhhhh   hhhhhhh = data (high)
-0lllllll   lllllll = data (low)
-F7h        End Of Exclusive
-*/
-/* Source: TX81Z Owner’s Manual PDF, pp.68–69 (Parameter Change Messages
-section).
-[1](https://usa.yamaha.com/files/download/other_assets/9/316769/TX81ZE.pdf)
-
-============================================================
- TX81Z — PARAMETER TABLES (Pages 71–73)
- Source: Yamaha TX81Z Owner’s Manual PDF
-============================================================
-
-------------------------------------------------------------
-VOICE EDIT PARAMETERS (VCED)
-------------------------------------------------------------
-Parameter number | Parameter                       | LCD          | Data
------------------|----------------------------------|--------------|-------------------------
-0                | Attack Rate                      | AR           | 0–31
-1                | Decay 1 Rate                     | D1R          | 0–31
-2                | Decay 2 Rate                     | D2R          | 0–31
-3                | Release Rate                     | RR           | 1–15
-4                | Decay 1 Level                    | D1L          | 0–15
-5                | Level Scaling                    | LS           | 0–99
-6                | Rate Scaling                     | RS           | 0–3
-7                | EG Bias Sensitivity              | EBS          | 0–7
-8                | Amplitude Modulation Enable      | AME          | 0–1
-9                | Key Velocity Sensitivity         | KVS          | 0–7
-10               | Operator Output Level            | OUT          | 0–99
-11               | Frequency (coarse)               | CRS          | 0–63
-12               | Detune                            | DET          | 0–6 (3=center)
-13–25            | Operator 3 parameters            | (same order) | (same ranges)
-26–38            | Operator 2 parameters            | (same order) | (same ranges)
-39–51            | Operator 1 parameters            | (same order) | (same ranges)
-52               | Algorithm                         | ALG          | 0–7
-53               | Feedback                          | Feedback     | 0–7
-54               | LFO Speed                         | Speed        | 0–99
-55               | LFO Delay                         | Delay        | 0–99
-56               | Pitch Modulation Depth            | P Mod Depth  | 0–99
-57               | Amp Modulation Depth              | A Mod Depth  | 0–99
-58               | LFO Sync                          | Sync         | 0–1
-59               | LFO Wave                          | Wave         | 0–3
-60               | Pitch Mod Sensitivity             | P Mod Sens   | 0–7
-61               | Amplitude Mod Sensitivity         | AMS          | 0–3
-62               | Transpose                         | Middle C =   | 0–48 (24=center)
-63               | Poly/Mono                         | Poly Mode    | 0–1
-64               | Pitch Bend Range                  | P Bend Range | 0–12
-65               | Portamento Mode                   | Full Time    | 0–1
-66               | Portamento Time                   | Porta Time   | 0–99
-67               | Foot Control Volume               | FC Volume    | 0–99
-68               | Sustain                            | (none)       | 0–1
-69               | Portamento                         | (none)       | 0–1
-70               | Chorus (not used)                  | (none)       | Always 0
-71               | Mod Wheel Pitch                   | MW Pitch     | 0–99
-72               | Mod Wheel Amplitude               | MW Ampl      | 0–99
-73               | Breath Control Pitch              | BC Pitch     | 0–99
-74               | Breath Control Amplitude          | BC Ampl      | 0–99
-75               | Breath Control Pitch Bias         | BC PitchBias | 0–99 (50=center)
-76               | Breath Control EG Bias            | BC EG Bias   | 0–99
-77–86            | Voice Name Characters 1–10        | ASCII        | 32–127
-93               | Operators 4–1 On/Off (bit mask)   | —            | 0–15 (1=on)
-(Parameters 87–92 are unused)
-
-------------------------------------------------------------
-ADDITIONAL VOICE EDIT PARAMETERS (ACED)
-------------------------------------------------------------
-Parameter number | Parameter                  | LCD    | Data
------------------|-----------------------------|--------|----------------------------
-0                | Fixed Frequency Mode        | FIX    | 0–1
-1                | Fixed Frequency Range       |        | 0–7  (0=250 Hz … 7=32 kHz)
-2                | Fine Frequency (fixed)      | FIN    | 0–15
-3                | Operator Waveform           | OSW    | 0–7
-4                | EG Shift                    | SHFT   | 0–3 (0=96dB, 1=48dB, 2=24dB, 3=12dB)
-5–9              | Operator 3 extra params     | —      | same order/type as op4
-10–14            | Operator 2 extra params     | —      | same order/type
-15–19            | Operator 1 extra params     | —      | same order/type
-20               | Reverb Rate                 | REV    | 0–7 (0=off, 7=fast)
-21               | FC Pitch                    | FC Pitch | 0–99
-22               | FC Amplitude                | FC Amplitude | 0–99
-
-------------------------------------------------------------
-PERFORMANCE EDIT PARAMETERS (PCED)
-------------------------------------------------------------
-Parameter number | Parameter               | LCD          | Data
------------------|--------------------------|--------------|-------------------------
-0                | Maximum Notes            | MAX NOTES    | 0–8
-1                | Voice Number MSB         | —            | (0–127 encoded)
-2                | Voice Number LSB         | 101–D32      | 0–127
-3                | Receive Channel          | RECEIVE CH   | 0–16 (16=omni)
-4                | Low Note Limit           | LIMIT/L      | 0–127 (C–2..G8)
-5                | High Note Limit          | LIMIT/H      | 0–127 (C–2..G8)
-6                | Instrument Detune        | INST DETUNE  | 0–14 (7=center)
-7                | Note Shift               | NOTE SHIFT   | 0–48 (24=center)
-8                | Volume                   | VOL          | 0–99
-9                | Output Assign            | OUT ASSIGN   | 0–3  (0=off, 1=I, 2=II, 3=I+II)
-10               | LFO Select               | LFO SELECT   | 0–3  (0=off, 1=inst1, 2=inst2, 3=vib)
-11               | Micro Tune Enable        | —            | 0–1
-12–23            | Instrument 2 parameters  | —            | Same structure
-24–35            | Instrument 3 parameters  | —            | Same
-36–47            | Instrument 4 parameters  | —            | Same
-48–59            | Instrument 5 parameters  | —            | Same
-60–71            | Instrument 6 parameters  | —            | Same
-72–83            | Instrument 7 parameters  | —            | Same
-84–95            | Instrument 8 parameters  | —            | Same
-96               | Micro Tune Table          | MICTUN       | 0–12 (0=Oct, 1=Full, 2–12=presets)
-97               | Assign Mode               | ASMODE       | 0–1 (0=norm, 1=altr)
-98               | Effect Select             | EFSEL        | 0–3 (off/Delay/Pan/Chord)
-99               | Key (for microtuning)     | KEY          | 0–11 (C–B)
-100–109          | Performance Name chars 1–10 | ASCII      | 32–127
-
-------------------------------------------------------------
-REMOTE SWITCH PARAMETERS
-------------------------------------------------------------
-Parameter number | Parameter
------------------|---------------------------
-64               | POWER ON (reset)
-65               | STORE
-66               | UTILITY
-67               | EDIT
-68               | PLAY
-69               | PARAMETER -1
-70               | PARAMETER +1
-71               | DATA ENTRY -1
-72               | DATA ENTRY +1
-73               | MASTER VOLUME -1
-74               | MASTER VOLUME +1
-75               | CURSOR
-
-(Data: 0 = switch off, 127 = switch on)
 */
 #include <map>
 #include "RtMidi.h"
+#include "engine.h"
+#include "control.h"
+#include "state.h"
+#include "smf.h"
+#include "capture.h"
+#include "perf.h"
+#include "log.h"
+#include <atomic>
 #include <chrono>
+#include <climits>
+#include <condition_variable>
 #include <csignal>
+#include <cstdio>
+#include <cstdlib>
 #include <ctime>
+#include <mutex>
+#include <thread>
 #include <sys/time.h>
 #include <unistd.h>
 const unsigned char nouts = 16;
 using namespace std;
 using std::chrono::duration_cast;
+using std::chrono::microseconds;
 using std::chrono::seconds;
+using std::chrono::steady_clock;
 using std::chrono::system_clock;
 
 const string PORT_PREFIX = "TX";
-static int lastSent[256] = {-1};
-static bool noteState[128] = {false};
-void onMIDI(double deltatime, std::vector<unsigned char>* message, void* userData);
-int limit(int val, int min, int max);
 unsigned char validCC[14] = { 1, 2, 7, 10, 64, 66, 120, 121, 122, 123, 124, 125, 126, 127 };
 void print();
 void cleanup();
 void listInports();
-void initHWPORT();
 void signalHandler(int signum);
-string oPORTNAME = "";
-bool HW_EXISTS = false;
 void listOutPorts();
 long long getSecs();
 int getOutPort(std::string str);
 int getInPort(std::string str);
 long long nextCheck = 0;
-void sendMessage(vector<unsigned char>* message);
-
-void updateAlgos(int algo);
-bool isSet(int n, int k); // bit checker
-vector<unsigned char> BASE_SYX { 0xF0, 0x43, 0x10, 0, 0, 0, 0xF7 };
-
-// TX-81Z Algorithm Structure:
-// Algo 1: 4->3->2->1  (only OP1 is carrier)           = 0b0001 = 1
-// Algo 2: (4+3)->2->1 (only OP1 is carrier)           = 0b0001 = 1
-// Algo 3: 4->(3+2)->1 (only OP1 is carrier)           = 0b0001 = 1
-// Algo 4: (4->3)+(2->1) (OP1 and OP3 are carriers)    = 0b0101 = 5
-// Algo 5: (4->2)+(4->1)+(3->1) (OP1 is carrier)       = 0b0001 = 1
-// Algo 6: (4->2)+(3->2)+(2->1) (only OP1 is carrier)  = 0b0001 = 1
-// Algo 7: 4+3+2->1 (only OP1 is carrier)              = 0b0001 = 1
-// Algo 8: 4+3+2+1 (all are carriers)                  = 0b1111 = 15
-const int ALGOS[8] = {
-    1, // Algorithm 0 (1): OP1 carrier
-    1, // Algorithm 1 (2): OP1 carrier
-    1, // Algorithm 2 (3): OP1 carrier
-    5, // Algorithm 3 (4): OP1 and OP3 carriers
-    1, // Algorithm 4 (5): OP1 carrier
-    1, // Algorithm 5 (6): OP1 carrier
-    1, // Algorithm 6 (7): OP1 carrier
-    15 // Algorithm 7 (8): all 4 operators are carriers
+
+// DIN MIDI runs at 31250 baud, 10 bits per byte on the wire.
+const int LINK_BYTES_PER_SEC = 3125;
+const int LINK_BURST = 64;    // bytes the link may bank while idle
+const int LINK_RESERVE = 24;  // headroom kept free for notes/knobs
+
+// Hardware outputs. Every port gets its own worker thread and bounded
+// queue so a slow DIN synth can never hold up a fast USB one. Notes and
+// other channel messages have their own lane which the worker always
+// drains before any pending sysex.
+const int OUT_QUEUE_SIZE = 256;
+// A message whose send fails goes back to the front of its lane and is
+// tried again after a backoff that doubles each time, until given up.
+const int SEND_RETRIES = 3;
+const long long SEND_BACKOFF_US = 2000;
+
+struct OUTQUEUE {
+  vector<vector<unsigned char>> ring;
+  vector<long long> stamps; // when each message's input arrived, with -latency
+  unsigned int head = 0, tail = 0, count = 0;
+  bool unbounded = false; // -render: doubles instead of dropping
+  OUTQUEUE() : ring(OUT_QUEUE_SIZE), stamps(OUT_QUEUE_SIZE) {
+    for (size_t i = 0; i < ring.size(); i++) ring[i].reserve(16);
+  }
+  bool push(long long us, const unsigned char *message, size_t size);
+  bool pushFront(long long us, const unsigned char *message, size_t size);
+  void pop(vector<unsigned char> &out, long long &us);
+  bool full();
+  unsigned int dropNoteOns(int channel, int &bytes);
 };
-enum BPOS {
-  GROUP = 3,
-  PARAMETER = 4,
-  DATA = 5
 
+// The worker is the only thread that sends, through whatever OUT holds
+// when a send starts. A reconnect opens a new RtMidiOut, publishes it
+// and retires the old one, which is freed once the worker's epoch shows
+// it is past every send that could have picked it up. Neither side waits
+// for the other, and while a port is away its queues hold what arrives.
+struct RETIRED {
+  RtMidiOut *out;
+  unsigned long epoch; // the worker's when it was replaced
 };
-enum CCTYPES { SYSTEM, SYSEX, SKIP, CC, MACRO };
-
-struct CC_MAPPING {
-  //  int x = 0;
-  CC_MAPPING(CCTYPES TYPE, int CC, int MIN, int MAX, int GROUP, int PARAMETER)
-      : TYPE(TYPE), CC(CC), MIN(MIN), MAX(MAX), GROUP(GROUP),
-        PARAMETER(PARAMETER) {};
-  CCTYPES TYPE = SKIP;
-  int CC = 0;
-  int MIN = 0;
-  int MAX = 99;
-  int GROUP = 0;
-  int PARAMETER = 0;
+
+struct OUTPORT {
+  string NAME;                  // matched against the ALSA port names
+  int RATE = LINK_BYTES_PER_SEC; // pacing in bytes/second, 0 = unpaced
+  std::atomic<RtMidiOut *> OUT{nullptr}; // swapped by initHWPORT()
+  std::atomic<unsigned long> epoch{0};   // odd while the worker sends
+  vector<RETIRED> retired;               // main thread only
+  SYNTH *synth = 0; // this port's profile and translation state
+  // Token bucket modelling the link. Everything that goes out is
+  // charged, but only modulation traffic ever waits for credit.
+  long long linkTokens = LINK_BURST * 1000000LL;
+  long long linkStamp = 0;
+  bool VIRTUAL = false;
+  std::atomic<bool> EXISTS{false};
+  bool RUN = true;
+  std::thread worker;
+  std::mutex lock;  // queues + counters
+  std::condition_variable wake;
+  OUTQUEUE notes, params;
+  // Notes on per channel, as queued or forwarded by -direct. Atomic, as
+  // the ALSA reader thread marks forwarded ones without a lock.
+  std::atomic<uint64_t> sounding[16][2] = {};
+  unsigned long queued = 0, sent = 0, dropped = 0, errors = 0, bytes = 0;
+  unsigned int maxDepth = 0;
+  // What -direct forwarded past the queues: bytes not yet charged to
+  // the link (linkRefill) and to the worker's pacing, and totals
+  std::atomic<int> forwardLink{0}, forwardWire{0};
+  std::atomic<unsigned long> forwarded{0}, forwardedBytes{0};
+  unsigned long pubBytes = 0; // bytes at the last state publish
+  long long pubUs = 0;
 };
-/*vector<CC_MAPPING> CARRIERS;
-vector<CC_MAPPING> MODULATORS;*/
-
-struct ENVS {
-  vector<int> CARRIERS;
-  vector<int> LCARRIERS;
-  vector<int> MODULATORS;
-  vector<int> LMODULATORS;
+vector<OUTPORT *> OUTPORTS;
+string defaultSynth = TX81Z::NAME;
+OUTPORT *addOutPort(string name, bool isVirtual);
+bool setSynth(OUTPORT *P, string profile);
+void sendTo(OUTPORT *P, const unsigned char *message, size_t size);
+void portEmit(void *ctx, const unsigned char *message, size_t size);
+void linkSpend(OUTPORT *P, int bytes);
+bool linkHasRoom(OUTPORT *P, int bytes);
+void initHWPORT(OUTPORT *P);
+void portWorker(OUTPORT *P);
+void portPanic(OUTPORT *P, int channel);
+void markSounding(OUTPORT *P, const unsigned char *message, size_t size);
+void retirePort(OUTPORT *P, RtMidiOut *out);
+void reclaimPorts(OUTPORT *P);
+void onPortError(RtMidiError::Type type, const string &text, void *userData);
+void onInputError(RtMidiError::Type type, const string &text, void *userData);
+thread_local bool portFailed = false; // set by on*Error() on its thread
+
+// -latency <ms>: instead of sending as soon as it can, each worker has
+// the kernel send every message LATENCY_US after the input it came from
+// arrived, on the shared client's queue. What the input thread, merge
+// and scheduling add in between then no longer moves notes around, as
+// long as it stays under the latency. Negative when off.
+long long LATENCY_US = -1;
+thread_local long long eventUs = 0; // stamp of the input onMIDI() is on
+volatile sig_atomic_t statsRequested = 0;
+volatile sig_atomic_t stopRequested = 0;
+
+// Inputs. TXCC is always there, -i and -vi add more. Each one has its own
+// RtMidiIn (so its own ALSA decoder and running status) and stamps what
+// it receives on its own clock. A single merge thread hands events to
+// onMIDI() oldest first, holding the oldest back at most MERGE_LOOKAHEAD
+// for a quieter input to catch up. A busy input only ever fills its own
+// queue, so it cannot push notes from another one back.
+const int IN_QUEUE_SIZE = 512;
+const long long IN_RESYNC_US = 100000; // source clock may lag this much
+
+struct INEVENT {
+  long long us = 0; // source timestamp on the getMicros() clock
+  vector<unsigned char> bytes;
+};
+struct INQUEUE {
+  vector<INEVENT> ring;
+  unsigned int head = 0, tail = 0, count = 0;
+  INQUEUE() : ring(IN_QUEUE_SIZE) {
+    for (size_t i = 0; i < ring.size(); i++) ring[i].bytes.reserve(16);
+  }
+  bool push(long long us, const unsigned char *message, size_t size);
+  void pop(INEVENT &out);
+};
+
+struct INPORT {
+  string NAME; // ALSA port name to match, or our own virtual port name
+  int ID = 0;  // index in INPORTS, the source number in captures
+  bool VIRTUAL = false;
+  std::atomic<bool> EXISTS{false};
+  RtMidiIn *IN = 0;
+  long long clock = 0; // last stamp, advanced by RtMidi's delta times
+  INQUEUE events;      // guarded by MERGE_LOCK, as are the counters
+  unsigned long received = 0, dropped = 0;
 };
-ENVS ATTACK, DECAY, SUSTAIN, RELEASE;
-
-CC_MAPPING MAP[128] = {
-    // Global/Voice Parameters (CC 0-27) - GROUP values: 18=VCED, 19=ACED
-    {SYSEX, 0, 0, 1, 18, 63},     // 0  Poly Mono mode
-    {SYSEX, 1, 0, 48, 18, 62},    // 1  Transpose
-    {CC, 2, 0, 127, 0, 0},        // 2  Breath
-    {SYSEX, 3, 0, 99, 18, 54},    // 3  LFO SPEED
-    {CC, 4, 0, 127, 0, 0},        // 4  Foot
-    {CC, 5, 0, 127, 0, 0},        // 5  Portamento
-    {SYSEX, 6, 0, 99, 18, 55},    // 6  LFO DELAY
-    {CC, 7, 0, 127, 0, 0},        // 7  Volume
-    {SYSEX, 8, 0, 99, 18, 56},    // 8  LFO PMD
-    {SYSEX, 9, 0, 99, 18, 57},    // 9  LFO AMD
-    {CC, 10, 0, 127, 0, 0},       // 10 PAN
-    {SYSEX, 11, 0, 12, 18, 64},   // 11 Pitch Bend Range
-    {SYSEX, 12, 0, 3, 18, 59},    // 12 LFO WAVE
-    {SYSEX, 13, 0, 1, 18, 58},    // 13 LFO Sync
-    {SYSEX, 14, 0, 7, 18, 60},    // 14 LFO PMS
-    {SYSEX, 15, 0, 3, 18, 61},    // 15 LFO AMS
-    {SYSEX, 16, 0, 1, 18, 65},    // 16 Portamento Mode
-    {SYSEX, 17, 0, 99, 18, 66},   // 17 Portamento Time
-    {SYSEX, 18, 0, 99, 18, 67},   // 18 FC Volume
-    {SYSEX, 19, 0, 1, 18, 68},    // 19 Sustain
-    {SYSEX, 20, 0, 99, 18, 69},   // 20 Portamento
-    {SYSEX, 21, 0, 99, 18, 71},   // 21 Mod Wheel Pitch
-    {SYSEX, 22, 0, 99, 18, 72},   // 22 Mod Wheel Amplitude
-    {SYSEX, 23, 0, 7, 19, 20},    // 23 Reverb Rate - ACED param
-    {SYSEX, 24, 0, 99, 19, 21},   // 24 FC Pitch - ACED param
-    {SYSEX, 25, 0, 99, 19, 22},   // 25 FC Amplitude - ACED param
-    {SYSEX, 26, 0, 7, 18, 52},    // 26 Algorithm
-    {SYSEX, 27, 0, 7, 18, 53},    // 27 Feedback
-    {SYSEX, 28, 0, 48, 18, 62},   // 28 Transpose
-    {SYSEX, 29, 0, 99, 18, 73},   // 29 BC Pitch
-    {SYSEX, 30, 0, 99, 18, 74},   // 30 BC Amplitude
-    {SYSEX, 31, 0, 99, 18, 75},   // 31 BC Pitch Bias
-    {SYSEX, 32, 0, 99, 18, 76},   // 32 BC EG Bias
-    {SYSEX, 33, 32, 127, 18, 77}, // 33 V Name Char 1
-    {SYSEX, 34, 32, 127, 18, 78}, // 34 V Name Char 2
-    {SYSEX, 35, 32, 127, 18, 79}, // 35 V Name Char 3
-    {SYSEX, 36, 32, 127, 18, 80}, // 36 V Name Char 4
-    {SYSEX, 37, 32, 127, 18, 81}, // 37 V Name Char 5
-    {SYSEX, 38, 32, 127, 18, 82}, // 38 V Name Char 6
-    {SYSEX, 39, 32, 127, 18, 83}, // 39 V Name Char 7
-    {SYSEX, 40, 32, 127, 18, 84}, // 40 V Name Char 8
-    {SYSEX, 41, 32, 127, 18, 85}, // 41 V Name Char 9
-    {SYSEX, 42, 32, 127, 18, 86}, // 42 V Name Char 10
-    {SYSEX, 43, 0, 15, 18, 93},   // 43 Operator on/off
-    {SYSEX, 44, 0, 7, 19, 20},    // 44 Reverb Rate
-    {SYSEX, 45, 0, 99, 19, 21},   // 45 FC Pitch
-    {SYSEX, 46, 0, 99, 19, 22},   // 46 FC Amplitude
-    // Operator  extra  parameters
-    {SYSEX, 47, 0, 7, 19, 1},  // 47 Op4 Fixed Frequency Range
-    {SYSEX, 48, 0, 15, 19, 2}, // 48 Op4 Fine Frequency
-    {SYSEX, 49, 0, 3, 19, 4},  // 49 Op4 EG shift
-    // OP3 ACED parameters (lines 355-357)
-    {SYSEX, 50, 0, 7, 19, 6},  // 50 Op3 Fixed Frequency Range
-    {SYSEX, 51, 0, 15, 19, 7}, // 51 Op3 Fine Frequency
-    {SYSEX, 52, 0, 3, 19, 9},  // 52 Op3 EG shift
-
-    // OP2 ACED parameters (lines 358-360)
-    {SYSEX, 53, 0, 7, 19, 11},  // 53 Op2 Fixed Frequency Range
-    {SYSEX, 54, 0, 15, 19, 12}, // 54 Op2 Fine Frequency
-    {SYSEX, 55, 0, 3, 19, 14},  // 55 Op2 EG shift
-
-    // OP1 ACED parameters (lines 361-363)
-    {SYSEX, 56, 0, 7, 19, 16},  // 56 Op1 Fixed Frequency Range
-    {SYSEX, 57, 0, 15, 19, 17}, // 57 Op1 Fine Frequency
-    {SYSEX, 58, 0, 3, 19, 19},  // 58 Op1 EG shift
-    {SKIP, 59, 0, 127, 0, 0},
-    {CC, 60, 0, 127, 0, 0}, // 60
-    {CC, 61, 0, 127, 0, 0}, // 61
-    {CC, 62, 0, 127, 0, 0}, // 62
-    {CC, 63, 0, 127, 0, 0}, // 63
-    // Standard MIDI CC pass-through (CC 64-66)
-    {CC, 64, 0, 127, 0, 0},   // 64 Sustain pedal
-    {SKIP, 65, 0, 127, 0, 0}, // 65
-    {CC, 66, 0, 127, 0, 0},   // 66 Sostenuto
-
-    // Operator-specific parameters - OP4 (CC 67-79) - EXPANDED
-    {SYSEX, 67, 0, 31, 18, 0},  // 67 OP4 Attack Rate (AR) - VCED
-    {SYSEX, 68, 0, 31, 18, 1},  // 68 OP4 Decay 1 Rate (D1R) - VCED
-    {SYSEX, 69, 0, 31, 18, 2},  // 69 OP4 Decay 2 Rate (D2R) - VCED
-    {SYSEX, 70, 0, 15, 18, 3},  // 70 OP4 Release Rate (RR) - VCED
-    {SYSEX, 71, 0, 15, 18, 4},  // 71 OP4 Decay 1 Level (D1L) - VCED
-    {SYSEX, 72, 0, 99, 18, 10}, // 72 OP4 Output Level (OUT) - VCED
-    {SYSEX, 73, 0, 63, 18, 11}, // 73 OP4 Frequency Coarse (CRS) - VCED
-    {SYSEX, 74, 0, 6, 18, 12},  // 74 OP4 Detune (DET) - VCED
-    {SYSEX, 75, 0, 99, 18, 5},  // 75 OP4 Level Scaling (LS) - VCED
-    {SYSEX, 76, 0, 3, 18, 6},   // 76 OP4 Rate Scaling (RS) - VCED **NEW**
-    {SYSEX, 77, 0, 7, 18, 9},   // 77 OP4 Key Velocity Sens (KVS) - VCED
-    {SYSEX, 78, 0, 7, 19, 3},   // 78 OP4 Waveform (OSW) - ACED
-    {SYSEX, 79, 0, 1, 19, 0},   // 79 OP4 Fixed Frequency Mode - ACED
-
-    // Operator-specific parameters - OP3 (CC 80-92) - EXPANDED
-    {SYSEX, 80, 0, 31, 18, 13}, // 80 OP3 Attack Rate (AR) - VCED
-    {SYSEX, 81, 0, 31, 18, 14}, // 81 OP3 Decay 1 Rate (D1R) - VCED
-    {SYSEX, 82, 0, 31, 18, 15}, // 82 OP3 Decay 2 Rate (D2R) - VCED
-    {SYSEX, 83, 0, 15, 18, 16}, // 83 OP3 Release Rate (RR) - VCED
-    {SYSEX, 84, 0, 15, 18, 17}, // 84 OP3 Decay 1 Level (D1L) - VCED
-    {SYSEX, 85, 0, 99, 18, 23}, // 85 OP3 Output Level (OUT) - VCED
-    {SYSEX, 86, 0, 63, 18, 24}, // 86 OP3 Frequency Coarse (CRS) - VCED
-    {SYSEX, 87, 0, 6, 18, 25},  // 87 OP3 Detune (DET) - VCED
-    {SYSEX, 88, 0, 99, 18, 18}, // 88 OP3 Level Scaling (LS) - VCED
-    {SYSEX, 89, 0, 3, 18, 19},  // 89 OP3 Rate Scaling (RS) - VCED **NEW**
-    {SYSEX, 90, 0, 7, 18, 22},  // 90 OP3 Key Velocity Sens (KVS) - VCED
-    {SYSEX, 91, 0, 7, 19, 8},   // 91 OP3 Waveform (OSW) - ACED
-    {SYSEX, 92, 0, 1, 19, 5},   // 92 OP3 Fixed Frequency Mode - ACED
-
-    // Operator-specific parameters - OP2 (CC 93-105) - EXPANDED
-    {SYSEX, 93, 0, 31, 18, 26},  // 93 OP2 Attack Rate (AR) - VCED
-    {SYSEX, 94, 0, 31, 18, 27},  // 94 OP2 Decay 1 Rate (D1R) - VCED
-    {SYSEX, 95, 0, 31, 18, 28},  // 95 OP2 Decay 2 Rate (D2R) - VCED
-    {SYSEX, 96, 0, 15, 18, 29},  // 96 OP2 Release Rate (RR) - VCED
-    {SYSEX, 97, 0, 15, 18, 30},  // 97 OP2 Decay 1 Level (D1L) - VCED
-    {SYSEX, 98, 0, 99, 18, 36},  // 98 OP2 Output Level (OUT) - VCED
-    {SYSEX, 99, 0, 63, 18, 37},  // 99 OP2 Frequency Coarse (CRS) - VCED
-    {SYSEX, 100, 0, 6, 18, 38},  // 100 OP2 Detune (DET) - VCED
-    {SYSEX, 101, 0, 99, 18, 31}, // 101 OP2 Level Scaling (LS) - VCED
-    {SYSEX, 102, 0, 3, 18, 32},  // 102 OP2 Rate Scaling (RS) - VCED **NEW**
-    {SYSEX, 103, 0, 7, 18, 35},  // 103 OP2 Key Velocity Sens (KVS) - VCED
-    {SYSEX, 104, 0, 7, 19, 13},  // 104 OP2 Waveform (OSW) - ACED
-    {SYSEX, 105, 0, 1, 19, 10},  // 105 OP2 Fixed Frequency Mode - ACED
-
-    // Operator-specific parameters - OP1 (CC 106-118) - EXPANDED
-    {SYSEX, 106, 0, 31, 18, 39}, // 106 OP1 Attack Rate (AR) - VCED
-    {SYSEX, 107, 0, 31, 18, 40}, // 107 OP1 Decay 1 Rate (D1R) - VCED
-    {SYSEX, 108, 0, 31, 18, 41}, // 108 OP1 Decay 2 Rate (D2R) - VCED
-    {SYSEX, 109, 0, 15, 18, 42}, // 109 OP1 Release Rate (RR) - VCED
-    {SYSEX, 110, 0, 15, 18, 43}, // 110 OP1 Decay 1 Level (D1L) - VCED
-    {SYSEX, 111, 0, 99, 18, 49}, // 111 OP1 Output Level (OUT) - VCED
-    {SYSEX, 112, 0, 63, 18, 50}, // 112 OP1 Frequency Coarse (CRS) - VCED
-    {SYSEX, 113, 0, 6, 18, 51},  // 113 OP1 Detune (DET) - VCED
-    {SYSEX, 114, 0, 99, 18, 44}, // 114 OP1 Level Scaling (LS) - VCED
-    {SYSEX, 115, 0, 3, 18, 45},  // 115 OP1 Rate Scaling (RS) - VCED **NEW**
-    {SYSEX, 116, 0, 7, 18, 48},  // 116 OP1 Key Velocity Sens (KVS) - VCED
-    {SYSEX, 117, 0, 7, 19, 18},  // 117 OP1 Waveform (OSW) - ACED
-    {SYSEX, 118, 0, 1, 19, 15},  // 118 OP1 Fixed Frequency Mode - ACED
-
-    // Reserved/Special purpose (CC 119)
-    {SKIP, 119, 0, 127, 0, 0}, // 119
-
-    // System messages (CC 120-127)
-    {SYSTEM, 120, 0, 127, 0, 0}, // 120 All Sound Off
-    {SYSTEM, 121, 0, 127, 0, 0}, // 121 Reset All Controllers
-    {SYSTEM, 122, 0, 127, 0, 0}, // 122 Local Control
-    {SYSTEM, 123, 0, 127, 0, 0}, // 123 All Notes Off
-    {SYSTEM, 124, 0, 127, 0, 0}, // 124 Omni Mode Off
-    {SYSTEM, 125, 0, 127, 0, 0}, // 125 Omni Mode On
-    {SYSTEM, 126, 0, 127, 0, 0}, // 126 Mono Mode On
-    {SYSTEM, 127, 0, 127, 0, 0}, // 127 Poly Mode On
+vector<INPORT *> INPORTS;
+std::mutex MERGE_LOCK;
+std::condition_variable MERGE_WAKE;
+bool MERGE_RUN = true;
+bool MERGE_BUSY = false; // an event is out of the queues, in onMIDI()
+std::thread merger;
+long long MERGE_LOOKAHEAD = 2000; // us, set with -lookahead <ms>
+INPORT *addInPort(string name, bool isVirtual, RtMidiIn *in);
+void initHWINPORT(INPORT *P);
+void onInput(const RtMidiIn::BatchMessage *messages, size_t count,
+             void *userData);
+void mergeWorker();
+
+// -ctl / -shm, see control.h
+string controlPath, controlShm;
+// -state, see state.h. Link figures are published this often.
+string stateName;
+const long long STATE_INTERVAL_US = 50000;
+long long nextPublish = 0;
+void publishState();
+
+// -render in.mid out.mid: the file goes through onMIDI() as if it were
+// played live, into an output port with no worker. renderDrain() stands
+// in for portWorker(), pacing on file time instead of the wall clock.
+struct RENDER_TIME {
+  RENDER_TIME(int division);
+  long long toUs(unsigned long tick);
+  unsigned long toTick(long long us); // rounds up, never early
+  void setTempo(unsigned long tick, long long usPerQuarter);
+  long long perTick; // us per tick, scaled by 'division' when not SMPTE
+  int division;
+  bool smpte;
+  unsigned long anchorTick = 0;
+  long long anchorUs = 0;
 };
+OUTPORT *RENDER_PORT = 0;
+string renderIn;
+long long RENDER_CLOCK = -1; // file time while rendering, see getMicros()
+bool renderFile(OUTPORT *P, const string &in, const string &out);
+void renderDrain(OUTPORT *P, SMF_WRITER &W, RENDER_TIME &T, long long &wire,
+                 long long until);
+
+// -capture / -replay, see capture.h
+CAPTURE *CAPTURING = 0;
+string capturePath, replayPath;
+bool replayFast = false;
+double replayRate = 0; // -replay-rate, events/second instead of capture time
+std::thread replayer;
+void replayWorker();
+
+#if defined(__RTMIDI_LOOPBACK__)
+// -loopback <log>: built on the in-process loopback API (see RtMidi.h), so
+// ports are RtMidiLoopback's and nothing reaches ALSA. Replays go in
+// through the inputs rather than straight to onMIDI(), exercising the
+// whole pipeline, and what the outputs sent is written to <log> at exit.
+const size_t LOOPBACK_RECORD = 1 << 20; // messages
+string loopbackLog;
+void writeLoopbackLog();
+#endif
+
+#if defined(__LINUX_ALSA__)
+// -direct, see routeDirect()
+bool directRoute = false;
+vector<unsigned char> directStatuses; // what is being forwarded
+bool routeDirect();
+void filterInputs();
+void onForward(const unsigned char *message, size_t size, void *userData);
+#endif
+
 RtMidiIn* midiIn = 0;
 RtMidiOut* SYX = 0;
-RtMidiOut* HWOUT = 0;
 
 int main(int argc, char *argv[]) {
+  // -shared has to be known before the first port is constructed
+  for (int i = 1; i < argc; i++) {
+    if (string(argv[i]) != "-shared") continue;
+#if defined(__LINUX_ALSA__)
+    RtMidiAlsaClient::share("txsex");
+#else
+    cout << "Error ! -shared needs txsex built for ALSA" << endl;
+    return 1;
+#endif
+  }
   midiIn = new RtMidiIn();
-  midiIn->setCallback(&onMIDI);
-  midiIn->ignoreTypes(false, false, true); // dont ignore clocK
+  addInPort(PORT_PREFIX + "CC", true, midiIn);
   SYX = new RtMidiOut();
-  HWOUT = new RtMidiOut();
   signal(SIGINT, signalHandler);
+  signal(SIGUSR1, signalHandler);
   //
-  if (argc > 1) {
-    string cmd(argv[1]);
+  for (int i = 1; i < argc; i++) {
+    string cmd(argv[i]);
     cout << "Command: " << cmd << endl;
     if (cmd == "-ports") {
       listOutPorts();
       cout << endl << endl;
-      //     listInports();
+      listInports();
       cleanup();
     }
 
     if (cmd == "-p") {
-      if (argc < 3) {
+      if (i + 1 >= argc) {
         cout << "Error ! Please Provide Midi Port Name to bind to!" << endl;
         cleanup();
       }
-      oPORTNAME = string(argv[2]);
-      initHWPORT();
+      initHWPORT(addOutPort(string(argv[++i]), false));
     }
-  }
 
-  if (oPORTNAME == "") {
-    SYX->openVirtualPort(PORT_PREFIX + "SYX");
-    cout << "txsex => Created Virtual Output Port: " << PORT_PREFIX << "SYX"
-         << endl;
-  }
-  midiIn->openVirtualPort(PORT_PREFIX + "CC");
-  cout << "txsex => Created Virtual Input Port: " << PORT_PREFIX << "CC"
-       << endl;
-  cout << "Send Your CC Commands to PORT: " << PORT_PREFIX << "CC" << endl;
-  updateAlgos(0);
-  while (true) // the main loop
-  {
-
-    if (oPORTNAME != "") {
-      long elapsed = getSecs() - nextCheck;
-      if (elapsed >= 2) {
-        int pid = getOutPort(oPORTNAME);
-        if (pid == -1) {
-          HW_EXISTS = false;
-        } else {
-          if (HW_EXISTS == false) {
-            initHWPORT();
-          }
-        }
-        nextCheck = getSecs() + 2;
+    if (cmd == "-i") {
+      if (i + 1 >= argc) {
+        cout << "Error ! Please Provide Midi Port Name to read from!" << endl;
+        cleanup();
       }
+      initHWINPORT(addInPort(string(argv[++i]), false, new RtMidiIn()));
     }
 
-    usleep(5000);
-  }
-  cleanup();
-  return 0;
-}
+    if (cmd == "-vi") {
+      if (i + 1 >= argc) {
+        cout << "Error ! -vi needs a name for the virtual input" << endl;
+        cleanup();
+      }
+      INPORT *P = addInPort(string(argv[++i]), true, new RtMidiIn());
+      portFailed = false;
+      P->IN->openVirtualPort(P->NAME);
+      if (portFailed) {
+        cout << "Error ! Could not create " << P->NAME << endl;
+        cleanup();
+      }
+      cout << "txsex => Created Virtual Input Port: " << P->NAME << endl;
+    }
 
-static bool _isTransmitting = false;
+    if (cmd == "-lookahead") {
+      if (i + 1 >= argc) {
+        cout << "Error ! -lookahead needs a time in milliseconds" << endl;
+        cleanup();
+      }
+      MERGE_LOOKAHEAD = (long long)(max(0.0, atof(argv[++i])) * 1000);
+    }
 
-void onMIDI(double deltatime, std::vector<unsigned char> *message, void * userData) {
-  if (message->size() < 3) return;
+    if (cmd == "-log-level") {
+      if (i + 1 >= argc || !setLogLevel(argv[++i])) {
+        cout << "Error ! -log-level needs error, warn, info or debug" << endl;
+        cleanup();
+      }
+    }
 
-  unsigned char b0 = message->at(0);
-  unsigned char b1 = message->at(1);
-  unsigned char b2 = message->at(2);
-  unsigned char typ = b0 & 0xF0;
+    if (cmd == "-ctl") {
+      if (i + 1 >= argc) {
+        cout << "Error ! -ctl needs a socket path, eg /tmp/txsex.sock" << endl;
+        cleanup();
+      }
+      controlPath = argv[++i];
+    }
 
-  // --- 1. CLEAN PASSTHROUGH (Notes, Pitch Bend, etc.) ---
-  // No filters or "Echo Killers" here to ensure zero latency/interference.
-  // The User Warning handles the "All MIDI Devices" loop.
-  if (typ != 0xB0) {
-    sendMessage(message);
-    return;
-  }
+    if (cmd == "-shm") {
+      if (i + 1 >= argc || argv[i + 1][0] != '/') {
+        cout << "Error ! -shm needs a shared memory name, eg /txsex" << endl;
+        cleanup();
+      }
+      controlShm = argv[++i];
+    }
 
-  // --- 2. CC MAPPING LOOKUP ---
-  int mCC = (int)b1;
-  CC_MAPPING C = MAP[mCC];
+    if (cmd == "-state") {
+      if (i + 1 >= argc || argv[i + 1][0] != '/') {
+        cout << "Error ! -state needs a shared memory name, eg /txsex-state"
+             << endl;
+        cleanup();
+      }
+      stateName = argv[++i];
+    }
 
-  // --- 2A. FIXED CC / SYSTEM Logic (The 3.7 Freeze Fix) ---
-  if (C.TYPE == CC || C.TYPE == SYSTEM) {
-    int rawIn = (int)b2;
+    if (cmd == "-render") {
+      if (i + 2 >= argc || RENDER_PORT) {
+        cout << "Error ! Usage: -render <in.mid> <out.mid>" << endl;
+        cleanup();
+      }
+      // A port like any other, so -synth and -rate after it apply to it
+      renderIn = argv[++i];
+      OUTPORT *P = new OUTPORT();
+      P->NAME = argv[++i];
+      P->VIRTUAL = true;
+      P->EXISTS = true;
+      // File time has no deadline: what the link can not take yet waits
+      // in the queue, however long it gets, instead of being dropped
+      P->notes.unbounded = P->params.unbounded = true;
+      setSynth(P, defaultSynth);
+      OUTPORTS.push_back(P);
+      RENDER_PORT = P;
+    }
 
-    // Deduplicate to prevent flooding
-    if (rawIn == lastSent[mCC]) return;
-    lastSent[mCC] = rawIn;
+    if (cmd == "-capture" || cmd == "-replay") {
+      if (i + 1 >= argc) {
+        cout << "Error ! " << cmd << " needs a capture file name" << endl;
+        cleanup();
+      }
+      (cmd == "-capture" ? capturePath : replayPath) = argv[++i];
+    }
 
-    // STATIC BUFFER: This is the exact memory isolation your Sysex uses.
-    // It prevents the 3.7 Midpoint (64) freeze by decoupling input/output pointers.
-    static std::vector<unsigned char> oCC = { 0xB0, 0, 0 };
-    oCC[0] = b0; // Keep original channel
-    oCC[1] = (unsigned char)C.CC;
-    oCC[2] = (unsigned char)rawIn;
+    if (cmd == "-fast") {
+      replayFast = true;
+    }
 
-    sendMessage(&oCC);
-    return;
-  }
+    if (cmd == "-replay-rate") {
+      if (i + 1 >= argc || atof(argv[i + 1]) <= 0) {
+        cout << "Error ! -replay-rate needs a number of events per second"
+             << endl;
+        cleanup();
+      }
+      replayRate = atof(argv[++i]);
+    }
 
-  // --- 2B. ORIGINAL SYSEX Logic (IDENTICAL TO YOUR STARTING CODE) ---
-  if (C.TYPE == SYSEX) {
-    int rawIn = (int)message->at(2);
-    int tMin = C.MIN;
-    int tMax = C.MAX;
-    int tRange = tMax - tMin;
-    int finalVal = tMin;
+    if (cmd == "-loopback") {
+#if defined(__RTMIDI_LOOPBACK__)
+      if (i + 1 >= argc) {
+        cout << "Error ! -loopback needs a log file name" << endl;
+        cleanup();
+      }
+      loopbackLog = argv[++i];
+      RtMidiLoopback::reserve(LOOPBACK_RECORD, LOOPBACK_RECORD * 8);
+#else
+      cout << "Error ! -loopback needs txsex built with -D__RTMIDI_LOOPBACK__"
+           << endl;
+      cleanup();
+#endif
+    }
 
-    if (tRange > 0) {
-      finalVal = tMin + ((rawIn * tRange) + 63) / 127;
+    if (cmd == "-latency") {
+#if defined(__LINUX_ALSA__)
+      if (i + 1 >= argc) {
+        cout << "Error ! -latency needs a time in milliseconds" << endl;
+        cleanup();
+      }
+      LATENCY_US = (long long)(max(0.0, atof(argv[++i])) * 1000);
+#else
+      cout << "Error ! -latency needs txsex built for ALSA" << endl;
+      cleanup();
+#endif
     }
 
-    if (finalVal == lastSent[mCC]) {
-      return;
+    if (cmd == "-direct") {
+#if defined(__LINUX_ALSA__)
+      directRoute = true;
+#else
+      cout << "Error ! -direct needs txsex built for ALSA" << endl;
+      cleanup();
+#endif
     }
-    lastSent[mCC] = finalVal;
 
-    if (finalVal > tMax) finalVal = tMax;
-    if (finalVal < tMin) finalVal = tMin;
+    if (cmd == "-synth") {
+      if (i + 1 >= argc) {
+        cout << "Error ! -synth needs a profile name (tx81z or dx7)" << endl;
+        cleanup();
+      }
+      // After a -p it applies to that port, before any it is the default.
+      string profile(argv[++i]);
+      bool ok;
+      if (OUTPORTS.empty()) {
+        SYNTH *probe = makeSynth(profile, 0, 0);
+        ok = probe != 0;
+        delete probe;
+      } else {
+        ok = setSynth(OUTPORTS.back(), profile);
+      }
+      if (!ok) {
+        cout << "Error ! Unknown synth profile: " << profile << endl;
+        cleanup();
+      }
+      if (OUTPORTS.empty()) defaultSynth = profile;
+    }
 
-    static std::vector<unsigned char> oSYX = BASE_SYX;
-    oSYX[BPOS::GROUP] = (unsigned char)C.GROUP;
-    oSYX[BPOS::PARAMETER] = (unsigned char)C.PARAMETER;
-    oSYX[BPOS::DATA] = (unsigned char)finalVal;
+    if (cmd == "-rate") {
+      if (i + 1 >= argc || OUTPORTS.empty()) {
+        cout << "Error ! -rate <bytes per second> must follow a -p port"
+             << endl;
+        cleanup();
+      }
+      OUTPORTS.back()->RATE = max(0, atoi(argv[++i]));
+    }
 
-    sendMessage(&oSYX);
-    return;
+    if (cmd == "-mod") {
+      if (i + 1 >= argc || !addModRoute(string(argv[++i]))) {
+        cout << "Error ! Usage: -mod vel|cp|pat:<cc>[:<max hz>[:<hysteresis>]]"
+             << endl;
+        cleanup();
+      }
+    }
   }
 
-  // --- 2C. ORIGINAL MACRO Logic (IDENTICAL TO YOUR STARTING CODE) ---
-  if (C.TYPE == MACRO) {
-    int rawIn = (int)message->at(2);
-    int finalVal = (rawIn * (C.MAX - C.MIN) + 63) / 127 + C.MIN;
+  if (RENDER_PORT) {
+    if (OUTPORTS.size() > 1) {
+      cout << "Error ! -render can not be combined with -p" << endl;
+      cleanup();
+    }
+    if (renderFile(RENDER_PORT, renderIn, RENDER_PORT->NAME))
+      cout << "txsex => Rendered " << renderIn << " to " << RENDER_PORT->NAME
+           << endl;
+    cleanup();
+  }
 
-    updateAlgos(finalVal);
+  if (OUTPORTS.empty()) {
+    SYX->openVirtualPort(PORT_PREFIX + "SYX");
+    addOutPort(PORT_PREFIX + "SYX", true)->RATE = 0;
+    cout << "txsex => Created Virtual Output Port: " << PORT_PREFIX << "SYX"
+         << endl;
+  }
+  portFailed = false;
+  midiIn->openVirtualPort(PORT_PREFIX + "CC");
+  if (portFailed) {
+    cout << "Error ! Could not create " << PORT_PREFIX << "CC" << endl;
+    cleanup();
+  }
+  cout << "txsex => Created Virtual Input Port: " << PORT_PREFIX << "CC"
+       << endl;
+  cout << "Send Your CC Commands to PORT: " << PORT_PREFIX << "CC" << endl;
+#if defined(__LINUX_ALSA__)
+  if (RtMidiAlsaClient::isShared())
+    cout << "txsex => All ports are on ALSA client "
+         << RtMidiAlsaClient::getClientId() << endl;
+  if (directRoute && !routeDirect()) cleanup();
+  filterInputs();
+  if (LATENCY_US >= 0) {
+    if (!RtMidiAlsaClient::isShared()) {
+      cout << "Error ! -latency needs -shared" << endl;
+      cleanup();
+    }
+    if (directRoute) { // forwarded events would overtake the scheduled ones
+      cout << "Error ! -latency and -direct do not go together" << endl;
+      cleanup();
+    }
+    cout << "txsex => Output scheduled " << LATENCY_US / 1000.0
+         << " ms after input" << endl;
+  }
+#endif
+  if (!stateName.empty()) {
+    if (!startState(stateName, OUTPORTS.size())) cleanup();
+    std::lock_guard<std::mutex> lock(ENGINE_MUTEX);
+    for (size_t i = 0; i < OUTPORTS.size(); i++)
+      OUTPORTS[i]->synth->setMirror(statePort(i));
+  }
+  if (!capturePath.empty()) {
+    CAPTURING = new CAPTURE();
+    if (!CAPTURING->open(capturePath)) cleanup();
+  }
+  startLog();
+  merger = std::thread(mergeWorker);
+  if (!replayPath.empty()) replayer = std::thread(replayWorker);
+  if (!startControl(controlPath, controlShm)) cleanup();
+  while (!stopRequested) // the main loop
+  {
 
-    ENVS ENV;
-    switch (C.PARAMETER) {
-      case 0: ENV = ATTACK; break;
-      case 1: ENV = DECAY; break;
-      case 2: ENV = SUSTAIN; break;
-      case 3: ENV = RELEASE; break;
+    long elapsed = getSecs() - nextCheck;
+    if (elapsed >= 2) {
+      for (size_t i = 0; i < OUTPORTS.size(); i++) {
+        OUTPORT *P = OUTPORTS[i];
+        if (P->VIRTUAL) continue;
+        int pid = getOutPort(P->NAME);
+        if (pid == -1) {
+          P->EXISTS = false;
+        } else {
+          if (P->EXISTS == false) {
+            initHWPORT(P);
+          }
+        }
+        reclaimPorts(P);
+      }
+      for (size_t i = 0; i < INPORTS.size(); i++) {
+        INPORT *P = INPORTS[i];
+        if (P->VIRTUAL) continue;
+        if (getInPort(P->NAME) == -1) {
+          P->EXISTS = false;
+        } else if (P->EXISTS == false) {
+          initHWINPORT(P);
+        }
+      }
+      nextCheck = getSecs() + 2;
+    }
+    if (statsRequested) {
+      statsRequested = 0;
+      printStats(cout);
     }
-    const std::vector<int>& params = (C.GROUP == 0) ? ENV.CARRIERS :
-                                     (C.GROUP == 1) ? ENV.MODULATORS :
-                                     (C.GROUP == 2) ? ENV.LCARRIERS : ENV.LMODULATORS;
-    for (size_t i = 0; i != params.size(); i++) {
-      message->at(1) = (unsigned char)params.at(i);
-      onMIDI(deltatime, message, nullptr);
+
+    serviceMods();
+    if (!stateName.empty() && getMicros() >= nextPublish) {
+      publishState();
+      nextPublish = getMicros() + STATE_INTERVAL_US;
     }
+    usleep(5000);
   }
-}
-int limit(int v, int min, int max) {
-  if (v < min)
-    v = min;
-  if (v > max)
-    v = max;
-  return v;
+  cout << "Process txsex Terminiated!" << endl;
+  cleanup();
+  return 0;
 }
 
 void listInports() {
@@ -625,14 +585,53 @@ void listOutPorts() {
   }
 }
 void cleanup() {
-  delete midiIn;
+  stopRequested = 1;
+  if (replayer.joinable()) replayer.join();
+  // Inputs first so nothing new arrives, then let the merge thread finish
+  // the event it may be translating before the outputs go away.
+  for (size_t i = 0; i < INPORTS.size(); i++) {
+    INPORTS[i]->IN->closePort();
+    delete INPORTS[i]->IN;
+  }
+  {
+    std::lock_guard<std::mutex> lk(MERGE_LOCK);
+    MERGE_RUN = false;
+  }
+  MERGE_WAKE.notify_one();
+  if (merger.joinable()) merger.join();
+  if (CAPTURING) CAPTURING->close();
+  stopControl();
+  for (size_t i = 0; i < OUTPORTS.size(); i++) {
+    OUTPORT *P = OUTPORTS[i];
+    {
+      std::lock_guard<std::mutex> lk(P->lock);
+      P->RUN = false;
+    }
+    P->wake.notify_one();
+    if (P->worker.joinable()) P->worker.join();
+  }
+  stopLog();
+  printStats(cout);
+#if defined(__RTMIDI_LOOPBACK__)
+  if (!loopbackLog.empty()) writeLoopbackLog();
+#endif
+  for (size_t i = 0; i < OUTPORTS.size(); i++) OUTPORTS[i]->synth->setMirror(0);
+  stopState();
+  for (size_t i = 0; i < OUTPORTS.size(); i++) {
+    OUTPORT *P = OUTPORTS[i];
+    if (!P->VIRTUAL) {
+      RtMidiOut *out = P->OUT.exchange(nullptr);
+      if (out) out->closePort();
+      delete out;
+      for (size_t r = 0; r < P->retired.size(); r++) delete P->retired[r].out;
+    }
+    delete P->synth;
+  }
   delete SYX;
-  HWOUT->closePort();
-  delete HWOUT;
   exit(0);
 }
 
-int getinPort(std::string str) {
+int getInPort(std::string str) {
   int nPorts = midiIn->getPortCount();
   for (int i = 0; i < nPorts; i++) {
     std::string portName = midiIn->getPortName(i);
@@ -641,7 +640,7 @@ int getinPort(std::string str) {
       return i;
     }
   }
-  return 99;
+  return -1;
 }
 int getOutPort(std::string str) {
   int nPorts = SYX->getPortCount();
@@ -654,39 +653,823 @@ int getOutPort(std::string str) {
   }
   return -1;
 }
-void initHWPORT() {
-  int oid = getOutPort(oPORTNAME);
-  if (oid != -1) {
-    if (HWOUT->isPortOpen()) {
-      HWOUT->closePort();
+OUTPORT *addOutPort(string name, bool isVirtual) {
+  OUTPORT *P = new OUTPORT();
+  P->NAME = name;
+  P->VIRTUAL = isVirtual;
+  P->EXISTS = isVirtual;
+  if (isVirtual) {
+    P->OUT = SYX;
+    SYX->setErrorCallback(&onPortError, P);
+  }
+  setSynth(P, defaultSynth);
+  OUTPORTS.push_back(P);
+  P->worker = std::thread(portWorker, P);
+  return P;
+}
+void initHWPORT(OUTPORT *P) {
+  // Our own port is called TXSYX, TXSYX2, ... so they stay distinguishable.
+  string ownName = PORT_PREFIX + "SYX";
+  for (size_t i = 1; i < OUTPORTS.size(); i++)
+    if (OUTPORTS[i] == P) ownName += to_string(i + 1);
+
+  int oid = getOutPort(P->NAME);
+  if (oid == -1) {
+    P->EXISTS = false;
+    cout << P->NAME << "Not Available Yet" << endl;
+    return;
+  }
+  // Opened on the side, the worker keeps the old endpoint until this
+  // one is ready. Errors go to onPortError(), they do not throw.
+  RtMidiOut *out = 0;
+  portFailed = false;
+  try {
+    out = new RtMidiOut();
+    out->setErrorCallback(&onPortError, P);
+    out->openPort((unsigned int)oid, ownName);
+  } catch (...) {
+    portFailed = true;
+  }
+  if (portFailed || !out->isPortOpen()) {
+    delete out;
+    P->EXISTS = false;
+    cout << "Error Opening: " << SYX->getPortName(oid) << "for Output"
+         << endl;
+    return;
+  }
+  cout << "Opened HW Port (" << SYX->getPortName(oid) << " as " << ownName
+       << ") for Output with ID: " << oid << endl;
+#if defined(__LINUX_ALSA__)
+  if (!directStatuses.empty()) // reconnected after routeDirect()
+    for (size_t i = 0; i < INPORTS.size(); i++)
+      if (!RtMidiAlsaClient::route(*INPORTS[i]->IN, *out, directStatuses,
+                                   &onForward, P))
+        cout << "txsex => Could not route " << INPORTS[i]->NAME << " to "
+             << P->NAME << endl;
+#endif
+  retirePort(P, P->OUT.exchange(out));
+  P->EXISTS = true;
+  // The worker may be waiting for EXISTS under the lock
+  { std::lock_guard<std::mutex> lk(P->lock); }
+  P->wake.notify_one();
+}
+// Old endpoints are freed once the worker's epoch has moved past the
+// one they were retired in, or was even then (no send under way, so
+// none can still start with them). Main thread only.
+void retirePort(OUTPORT *P, RtMidiOut *out) {
+  if (out) P->retired.push_back({ out, P->epoch.load() });
+  reclaimPorts(P);
+}
+void reclaimPorts(OUTPORT *P) {
+  unsigned long now = P->epoch.load();
+  for (size_t i = P->retired.size(); i-- > 0;) {
+    RETIRED &R = P->retired[i];
+    if (R.epoch % 2 && now == R.epoch) continue;
+    delete R.out;
+    P->retired.erase(P->retired.begin() + i);
+  }
+}
+INPORT *addInPort(string name, bool isVirtual, RtMidiIn *in) {
+  INPORT *P = new INPORT();
+  P->NAME = name;
+  P->VIRTUAL = isVirtual;
+  P->EXISTS = isVirtual;
+  P->IN = in;
+  P->ID = INPORTS.size();
+  P->IN->setErrorCallback(&onInputError, P);
+  P->IN->setBatchCallback(&onInput, P);
+  P->IN->ignoreTypes(false, false, true); // dont ignore clocK
+  INPORTS.push_back(P);
+  return P;
+}
+void initHWINPORT(INPORT *P) {
+  // Read through our own TXIN1, TXIN2, ... ports
+  string ownName = PORT_PREFIX + "IN";
+  int n = 0;
+  for (size_t i = 0; i < INPORTS.size(); i++) {
+    if (!INPORTS[i]->VIRTUAL) n++;
+    if (INPORTS[i] == P) break;
+  }
+  ownName += to_string(n);
+
+  int iid = getInPort(P->NAME);
+  if (iid != -1) {
+    if (P->IN->isPortOpen()) {
+      P->IN->closePort();
     }
+    // Errors go to onInputError(), they do not throw
+    portFailed = false;
     try {
-      HWOUT->openPort((unsigned int)oid, PORT_PREFIX + "SYX");
-      HW_EXISTS = true;
-      cout << "Opened HW Port (" << SYX->getPortName(oid) << " as "
-           << PORT_PREFIX << "SYX) for Output with ID: " << oid << endl;
+      P->IN->openPort((unsigned int)iid, ownName);
     } catch (...) {
-      HW_EXISTS = false;
-      cout << "Error Opening: " << SYX->getPortName(oid) << "for Output"
+      portFailed = true;
+    }
+    if (portFailed || !P->IN->isPortOpen()) {
+      P->EXISTS = false;
+      cout << "Error Opening: " << midiIn->getPortName(iid) << "for Input"
            << endl;
+    } else {
+      P->EXISTS = true;
+      cout << "Opened HW Port (" << midiIn->getPortName(iid) << " as "
+           << ownName << ") for Input with ID: " << iid << endl;
     }
   } else {
-    HW_EXISTS = false;
-    cout << oPORTNAME << "Not Available Yet" << endl;
+    P->EXISTS = false;
+    cout << P->NAME << "Not Available Yet" << endl;
   }
 }
-void sendMessage(vector<unsigned char> *message) {
-  if (oPORTNAME == "")
-    SYX->sendMessage(message);
-  else {
+bool setSynth(OUTPORT *P, string profile) {
+  SYNTH *synth = makeSynth(profile, portEmit, P);
+  if (!synth) return false;
+  delete P->synth;
+  P->synth = synth;
+  return true;
+}
+void sendMessage(const unsigned char *message, size_t size) {
+  for (size_t i = 0; i < OUTPORTS.size(); i++)
+    sendTo(OUTPORTS[i], message, size);
+}
+int outputCount() { return OUTPORTS.size(); }
+void outputPanic(int output, int channel) {
+  portPanic(OUTPORTS[output], channel);
+}
+SYNTH *outputSynth(int output) { return OUTPORTS[output]->synth; }
+bool outputHasRoom(int output, int bytes) {
+  return linkHasRoom(OUTPORTS[output], bytes);
+}
+void portEmit(void *ctx, const unsigned char *message, size_t size) {
+  sendTo(static_cast<OUTPORT *>(ctx), message, size);
+}
+void sendTo(OUTPORT *P, const unsigned char *message, size_t size) {
+  // Sends that did not come from an input (knob flushes, the control
+  // socket) count from now
+  long long us = eventUs ? eventUs : LATENCY_US >= 0 ? getMicros() : 0;
+  {
+    std::lock_guard<std::mutex> lk(P->lock);
+    OUTQUEUE &Q = message[0] == 0xF0 ? P->params : P->notes;
+    if (!Q.push(us, message, size)) {
+      P->dropped++;
+      return;
+    }
+    P->queued++;
+    markSounding(P, message, size);
+    unsigned int depth = P->notes.count + P->params.count;
+    if (depth > P->maxDepth) P->maxDepth = depth;
+  }
+  linkSpend(P, size); // only what will go out uses the link
+  P->wake.notify_one();
+}
 
-    try {
-      HWOUT->sendMessage(message);
-    } catch (...) {
-      cout << "Error Sendind Midi to: " << oPORTNAME << endl;
+// Full, unless it is unbounded: then it makes room, keeping the order.
+bool OUTQUEUE::full() {
+  if (count < ring.size()) return false;
+  if (!unbounded) return true;
+  vector<vector<unsigned char>> bigger(ring.size() * 2);
+  vector<long long> biggerStamps(bigger.size());
+  for (unsigned int i = 0; i < count; i++) {
+    bigger[i].swap(ring[(head + i) % ring.size()]);
+    biggerStamps[i] = stamps[(head + i) % ring.size()];
+  }
+  ring.swap(bigger);
+  stamps.swap(biggerStamps);
+  head = 0;
+  tail = count;
+  return false;
+}
+void markSounding(OUTPORT *P, const unsigned char *message, size_t size) {
+  if (size < 3 || (message[0] & 0xE0) != 0x80) return; // note on/off only
+  uint64_t bit = 1ULL << (message[1] & 63);
+  std::atomic<uint64_t> &notes = P->sounding[message[0] & 0x0F][(message[1] >> 6) & 1];
+  if ((message[0] & 0xF0) == 0x90 && message[2]) notes.fetch_or(bit);
+  else notes.fetch_and(~bit);
+}
+
+bool OUTQUEUE::push(long long us, const unsigned char *message, size_t size) {
+  if (full()) return false;
+  stamps[tail] = us;
+  ring[tail].assign(message, message + size);
+  tail = (tail + 1) % ring.size();
+  count++;
+  return true;
+}
+bool OUTQUEUE::pushFront(long long us, const unsigned char *message,
+                         size_t size) {
+  if (full()) return false;
+  head = (head + ring.size() - 1) % ring.size();
+  stamps[head] = us;
+  ring[head].assign(message, message + size);
+  count++;
+  return true;
+}
+void OUTQUEUE::pop(vector<unsigned char> &out, long long &us) {
+  us = stamps[head];
+  out.swap(ring[head]); // hand the buffers round instead of copying
+  head = (head + 1) % ring.size();
+  count--;
+}
+// Takes the note ons of a channel out, adding their size to bytes. The
+// rest keeps its order: a note-off may be for a note that already went.
+unsigned int OUTQUEUE::dropNoteOns(int channel, int &bytes) {
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < count; i++) {
+    vector<unsigned char> &m = ring[(head + i) % ring.size()];
+    if (m.size() >= 3 && m[0] == (0x90 | channel) && m[2]) {
+      bytes += m.size();
+      continue;
+    }
+    if (kept != i) {
+      ring[(head + kept) % ring.size()].swap(m);
+      stamps[(head + kept) % ring.size()] = stamps[(head + i) % ring.size()];
+    }
+    kept++;
+  }
+  unsigned int dropped = count - kept;
+  count = kept;
+  tail = (head + count) % ring.size();
+  return dropped;
+}
+
+bool INQUEUE::push(long long us, const unsigned char *message, size_t size) {
+  if (count == ring.size()) return false;
+  ring[tail].us = us;
+  ring[tail].bytes.assign(message, message + size);
+  tail = (tail + 1) % ring.size();
+  count++;
+  return true;
+}
+void INQUEUE::pop(INEVENT &out) {
+  out.us = ring[head].us;
+  out.bytes.swap(ring[head].bytes);
+  head = (head + 1) % ring.size();
+  count--;
+}
+
+// Everything the input read in one wakeup, copied once into its queue
+// under a single MERGE_LOCK, with a single wakeup of the merge thread.
+void onInput(const RtMidiIn::BatchMessage *messages, size_t count,
+             void *userData) {
+  PERF_SCOPE perf(PERF_INPUT, count);
+  INPORT *P = static_cast<INPORT *>(userData);
+  long long now = getMicros();
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lk(MERGE_LOCK);
+    for (size_t i = 0; i < count; i++) {
+      // RtMidi gives the time since this input's previous event. Follow
+      // that, but never ahead of now and never so far behind that an
+      // idle or drifting source would jump the queue.
+      P->clock += (long long)(messages[i].info.timeStamp * 1000000.0);
+      if (P->received == 0 || P->clock > now || now - P->clock > IN_RESYNC_US)
+        P->clock = now;
+      P->received++;
+      if (P->events.push(P->clock, messages[i].message, messages[i].size))
+        queued = true;
+      else
+        P->dropped++;
+    }
+  }
+  if (queued) MERGE_WAKE.notify_one();
+}
+
+void mergeWorker() {
+  INEVENT ev;
+  ev.bytes.reserve(16);
+  std::unique_lock<std::mutex> lk(MERGE_LOCK);
+  while (MERGE_RUN) {
+    // The oldest head is safe to release once every other live input
+    // has something queued (nothing older can still turn up), or once
+    // it has waited out the lookahead.
+    INPORT *first = 0;
+    bool complete = true;
+    for (size_t i = 0; i < INPORTS.size(); i++) {
+      INPORT *P = INPORTS[i];
+      if (P->events.count == 0) {
+        if (P->EXISTS) complete = false;
+        continue;
+      }
+      if (!first || P->events.ring[P->events.head].us <
+                        first->events.ring[first->events.head].us)
+        first = P;
+    }
+    if (!first) {
+      MERGE_WAKE.wait(lk);
+      continue;
+    }
+    long long due = first->events.ring[first->events.head].us + MERGE_LOOKAHEAD;
+    long long now = getMicros();
+    if (!complete && now < due) {
+      MERGE_WAKE.wait_for(lk, microseconds(due - now));
+      continue;
+    }
+    first->events.pop(ev);
+    MERGE_BUSY = true;
+    lk.unlock();
+    if (CAPTURING) CAPTURING->record(ev.us, first->ID, ev.bytes.data(), ev.bytes.size());
+    {
+      PERF_SCOPE perf(PERF_TRANSLATE);
+      eventUs = ev.us;
+      onMIDI(0, &ev.bytes, first);
+      eventUs = 0;
+    }
+    lk.lock();
+    MERGE_BUSY = false;
+  }
+}
+
+// Feeds a capture straight to onMIDI(): it was recorded after the merge,
+// so it is already in order. On the loopback API it goes in through the
+// inputs instead, so the merge thread sees it too. Paced on the capture's
+// own timing, at -replay-rate or not at all with -fast. Stops txsex once
+// the inputs and outputs have drained.
+void replayWorker() {
+  REPLAY R;
+  if (!R.open(replayPath)) {
+    stopRequested = 1;
+    return;
+  }
+  cout << "txsex => Replaying " << replayPath
+       << (replayFast ? " as fast as possible"
+                      : replayRate > 0 ? " at a fixed rate" : " in real time")
+       << endl;
+  vector<unsigned char> bytes;
+  bytes.reserve(256);
+  long long us;
+  int source;
+  unsigned long count = 0, lost = 0;
+  long long start = getMicros();
+  while (!stopRequested && R.next(us, source, bytes)) {
+    long long due = replayRate > 0 ? (long long)(count * 1000000.0 / replayRate) : us;
+    while (!replayFast && !stopRequested) { // sleep in slices, for SIGINT
+      long long wait = start + due - getMicros();
+      if (wait <= 0) break;
+      std::this_thread::sleep_for(microseconds(min(wait, 100000LL)));
+    }
+    INPORT *P = source < (int)INPORTS.size() ? INPORTS[source] : INPORTS[0];
+#if defined(__RTMIDI_LOOPBACK__)
+    if (!RtMidiLoopback::inject(P->NAME, bytes.data(), bytes.size())) lost++;
+#else
+    onMIDI(0, &bytes, P);
+#endif
+    count++;
+  }
+  long long took = max(1LL, getMicros() - start);
+  cout << "txsex => Replayed " << count << " events in " << took / 1000
+       << "ms (" << count * 1000000LL / took << " events/sec)" << endl;
+  if (lost) cout << "txsex => " << lost << " had no input port to go to" << endl;
+  while (!stopRequested) {
+    {
+      std::lock_guard<std::mutex> lk(MERGE_LOCK);
+      size_t pending = 0;
+      for (size_t i = 0; i < INPORTS.size(); i++) pending += INPORTS[i]->events.count;
+      if (pending == 0 && !MERGE_BUSY) break;
+    }
+    usleep(1000);
+  }
+  for (size_t i = 0; i < OUTPORTS.size() && !stopRequested; i++) {
+    while (!stopRequested) {
+      {
+        std::lock_guard<std::mutex> lk(OUTPORTS[i]->lock);
+        if (OUTPORTS[i]->notes.count + OUTPORTS[i]->params.count == 0) break;
+      }
+      usleep(10000);
+    }
+  }
+  stopRequested = 1;
+}
+
+#if defined(__RTMIDI_LOOPBACK__)
+// One line per message the outputs sent, tab separated: seconds since
+// startup, port name, then the bytes in hex.
+void writeLoopbackLog() {
+  FILE *f = fopen(loopbackLog.c_str(), "w");
+  if (!f) {
+    cout << "txsex => Could not create " << loopbackLog << endl;
+    return;
+  }
+  double time;
+  string port;
+  vector<unsigned char> message;
+  size_t n = 0;
+  for (; RtMidiLoopback::getRecord(n, &time, &port, &message); n++) {
+    fprintf(f, "%.6f\t%s\t", time, port.c_str());
+    for (size_t i = 0; i < message.size(); i++)
+      fprintf(f, i ? " %02X" : "%02X", message[i]);
+    fputc('\n', f);
+  }
+  fclose(f);
+  cout << "txsex => Loopback: " << n << " messages logged to " << loopbackLog;
+  if (RtMidiLoopback::getOverflow())
+    cout << ", " << RtMidiLoopback::getOverflow() << " more did not fit";
+  cout << endl;
+}
+#endif
+
+#if defined(__LINUX_ALSA__)
+// Channel messages other than CCs come out the way they went in, so with
+// -direct the shared client's reader forwards them to every output as
+// they arrive, and they never reach onMIDI(). What a -mod route listens
+// to stays on the normal path, note offs along with note ons so a short
+// note can not end before it started.
+bool routeDirect() {
+  if (!RtMidiAlsaClient::isShared()) {
+    cout << "Error ! -direct needs -shared" << endl;
+    return false;
+  }
+  bool velocity = false, polyAT = false, chanPressure = false;
+  for (size_t i = 0; i < MODS.size(); i++) {
+    velocity |= MODS[i].SOURCE == VELOCITY;
+    polyAT |= MODS[i].SOURCE == POLYAT;
+    chanPressure |= MODS[i].SOURCE == CHANPRESS;
+  }
+  vector<unsigned char> &statuses = directStatuses;
+  if (!velocity) statuses.insert(statuses.end(), { 0x80, 0x90 });
+  if (!polyAT) statuses.push_back(0xA0);
+  statuses.push_back(0xC0);
+  if (!chanPressure) statuses.push_back(0xD0);
+  statuses.push_back(0xE0);
+
+  for (size_t i = 0; i < INPORTS.size(); i++)
+    for (size_t o = 0; o < OUTPORTS.size(); o++)
+      if (OUTPORTS[o]->OUT &&
+          !RtMidiAlsaClient::route(*INPORTS[i]->IN, *OUTPORTS[o]->OUT.load(),
+                                   statuses, &onForward, OUTPORTS[o])) {
+        cout << "txsex => Could not route " << INPORTS[i]->NAME << " to "
+             << OUTPORTS[o]->NAME << endl;
+        return false;
+      }
+  cout << "txsex => Forwarded straight to the outputs:";
+  for (size_t i = 0; i < statuses.size(); i++)
+    cout << " " << hex << uppercase << (statuses[i] >> 4) << "x" << dec
+         << nouppercase;
+  cout << endl;
+  return true;
+}
+
+// The sequencer drops whatever nothing here uses before it is read:
+// only what onMIDI() acts on and what -direct forwards gets through.
+// Call it again when either changes.
+void filterInputs() {
+  vector<unsigned char> statuses = inputStatuses();
+  statuses.insert(statuses.end(), directStatuses.begin(), directStatuses.end());
+  for (size_t i = 0; i < INPORTS.size(); i++)
+    if (!RtMidiAlsaClient::setEventFilter(*INPORTS[i]->IN, statuses))
+      cout << "txsex => Could not filter events for " << INPORTS[i]->NAME
+           << endl;
+}
+#endif
+
+void portWorker(OUTPORT *P) {
+  vector<unsigned char> out;
+  out.reserve(16);
+  long long nextFree = 0, stamp = 0;
+  int failures = 0; // in a row, for the message at the front
+  std::unique_lock<std::mutex> lk(P->lock);
+  while (true) {
+    // While the port is away its queues hold on to what arrives
+    P->wake.wait(lk, [P] {
+      return !P->RUN || (P->EXISTS && (P->notes.count || P->params.count));
+    });
+    if (!P->RUN) break;
+    (P->notes.count ? P->notes : P->params).pop(out, stamp);
+    lk.unlock();
+
+    // Pace to the port's wire rate so the synth's receive buffer never
+    // sees more than the link could physically have delivered.
+    long long now = getMicros();
+    int forwarded = P->forwardWire.exchange(0); // went out ahead of us
+    if (forwarded && P->RATE > 0)
+      nextFree = max(now, nextFree) + forwarded * 1000000LL / P->RATE;
+    long long at = -1; // when the kernel is to send it, with -latency
+    if (LATENCY_US >= 0) {
+      // Paced on the kernel's timeline, never before what went ahead of
+      // it, and handed over no more than the latency early so the lanes
+      // still decide the order.
+      at = max(max(stamp + LATENCY_US, now), nextFree);
+      if (at - LATENCY_US > now) {
+        std::this_thread::sleep_for(microseconds(at - LATENCY_US - now));
+        now = at - LATENCY_US;
+      }
+    } else if (P->RATE > 0 && nextFree > now) {
+      std::this_thread::sleep_for(microseconds(nextFree - now));
+      now = nextFree;
+    }
+    bool ok = false;
+    P->epoch++; // odd: OUT, as loaded below, may be in use
+    {
+      PERF_SCOPE perf(PERF_OUTPUT);
+      try {
+        portFailed = false;
+#if defined(__LINUX_ALSA__)
+        if (at >= 0)
+          ok = RtMidiAlsaClient::sendAfter(*P->OUT.load(), out.data(),
+                                           out.size(), (at - now) / 1e6) &&
+               !portFailed;
+        else
+#endif
+        {
+          P->OUT.load()->sendMessage(&out);
+          ok = !portFailed;
+        }
+      } catch (...) {
+      }
+    }
+    P->epoch++;
+    if (ok && at >= 0)
+      nextFree = at + (P->RATE > 0 ? out.size() * 1000000LL / P->RATE : 0);
+    else if (ok && P->RATE > 0)
+      nextFree = max(now, nextFree) + out.size() * 1000000LL / P->RATE;
+
+    lk.lock();
+    if (ok) {
+      P->sent++;
+      P->bytes += out.size();
+      failures = 0;
+      continue;
     }
+    P->errors++;
+    OUTQUEUE &Q = out[0] == 0xF0 ? P->params : P->notes;
+    if (failures == SEND_RETRIES || !Q.pushFront(stamp, out.data(), out.size())) {
+      logMessage(LOG_ERROR, "Error Sending Midi to: %s, message lost",
+                 P->NAME.c_str());
+      failures = 0;
+      continue;
+    }
+    logMessage(LOG_WARN, "Error Sending Midi to: %s, retrying",
+               P->NAME.c_str());
+    P->wake.wait_for(lk, microseconds(SEND_BACKOFF_US << failures++),
+                     [P] { return !P->RUN; });
   }
 }
+
+// Silences a channel of a port with the fewest bytes: the channel's
+// queued note ons are taken out and a note-off for each note still
+// sounding goes to the front of the queue. Queued note-offs stay, as
+// their note-on may already have been sent. The offs all share one
+// status, so the link sends them with running status.
+void portPanic(OUTPORT *P, int channel) {
+  int offs = 0, refund = 0;
+  long long us = LATENCY_US >= 0 ? getMicros() : 0;
+  {
+    std::lock_guard<std::mutex> lk(P->lock);
+    P->queued -= P->notes.dropNoteOns(channel, refund); // as if never queued
+    uint64_t sounding[2] = { P->sounding[channel][0].exchange(0),
+                             P->sounding[channel][1].exchange(0) };
+    unsigned char off[3] = { (unsigned char)(0x80 | channel), 0, 0 };
+    for (int note = 127; note >= 0; note--) { // lowest ends up first
+      if (!(sounding[note >> 6] & 1ULL << (note & 63))) continue;
+      off[1] = note;
+      if (!P->notes.pushFront(us, off, 3)) {
+        P->dropped++;
+        continue;
+      }
+      P->queued++;
+      offs++;
+    }
+  }
+  linkSpend(P, (offs ? 1 + 2 * offs : 0) - refund);
+  if (offs) P->wake.notify_one();
+}
+
+// RtMidi's errors for an output, instead of printing to cerr from
+// whichever thread hit them. A send or open that reports one failed.
+void onPortError(RtMidiError::Type type, const string &text, void *userData) {
+  OUTPORT *P = static_cast<OUTPORT *>(userData);
+  if (type == RtMidiError::DEBUG_WARNING) {
+    logMessage(LOG_DEBUG, "txsex => %s: %s", P->NAME.c_str(), text.c_str());
+    return;
+  }
+  portFailed = true;
+  logMessage(LOG_WARN, "txsex => %s: %s", P->NAME.c_str(), text.c_str());
+}
+
+// The same for an input. Most arrive on the thread reading it.
+void onInputError(RtMidiError::Type type, const string &text, void *userData) {
+  INPORT *P = static_cast<INPORT *>(userData);
+  if (type == RtMidiError::DEBUG_WARNING) {
+    logMessage(LOG_DEBUG, "txsex => %s: %s", P->NAME.c_str(), text.c_str());
+    return;
+  }
+  portFailed = true;
+  logMessage(LOG_WARN, "txsex => %s: %s", P->NAME.c_str(), text.c_str());
+}
+
+#if defined(__LINUX_ALSA__)
+// What -direct sent from an output behind its queues, on the ALSA
+// reader thread: charged to the link and the worker's pacing the next
+// time they look, so both count it without a lock, and its notes
+// marked as sounding.
+void onForward(const unsigned char *message, size_t size, void *userData) {
+  OUTPORT *P = static_cast<OUTPORT *>(userData);
+  P->forwardLink += size;
+  P->forwardWire += size;
+  P->forwarded++;
+  P->forwardedBytes += size;
+  markSounding(P, message, size); // so a panic silences forwarded notes too
+}
+#endif
+
+void printStats(ostream &out) {
+  {
+    std::lock_guard<std::mutex> lk(MERGE_LOCK);
+    for (size_t i = 0; i < INPORTS.size(); i++) {
+      INPORT *P = INPORTS[i];
+      out << "txsex => input " << P->NAME << ": received " << P->received
+           << ", dropped " << P->dropped << ", pending " << P->events.count
+           << endl;
+    }
+  }
+  for (size_t i = 0; i < OUTPORTS.size(); i++) {
+    OUTPORT *P = OUTPORTS[i];
+    std::lock_guard<std::mutex> lk(P->lock);
+    out << "txsex => " << P->NAME << " (" << P->synth->name() << "): queued " << P->queued << ", sent "
+         << P->sent << " (" << P->bytes << " bytes), dropped " << P->dropped
+         << ", errors " << P->errors << ", max depth " << P->maxDepth
+         << ", pending " << P->notes.count + P->params.count;
+    if (P->forwarded)
+      out << ", forwarded " << P->forwarded << " (" << P->forwardedBytes
+          << " bytes)";
+    out << endl;
+  }
+  perfReport(out);
+}
+bool controlCC(int port, unsigned char status, int cc, int value, int range) {
+  if (port < -1 || port >= (int)OUTPORTS.size()) return false;
+  std::lock_guard<std::mutex> lock(ENGINE_MUTEX);
+  onControl(port, status, cc, value, range);
+  return true;
+}
+int controlVoice(int port, const vector<vector<unsigned char>> &dump) {
+  if (port < -1 || port >= (int)OUTPORTS.size()) return -1;
+  std::lock_guard<std::mutex> lock(ENGINE_MUTEX);
+  int n = 0;
+  for (size_t i = 0; i < OUTPORTS.size(); i++) {
+    if (port >= 0 && (int)i != port) continue;
+    bool loaded = false;
+    for (size_t m = 0; m < dump.size(); m++)
+      loaded |= OUTPORTS[i]->synth->loadVoice(dump[m].data(), dump[m].size());
+    if (!loaded) continue;
+    OUTPORTS[i]->synth->sendVoice();
+    n++;
+  }
+  return n;
+}
+bool controlPanic(int port) {
+  if (port < -1 || port >= (int)OUTPORTS.size()) return false;
+  std::lock_guard<std::mutex> lock(ENGINE_MUTEX);
+  for (size_t i = 0; i < OUTPORTS.size(); i++)
+    if (port < 0 || (int)i == port)
+      for (int channel = 0; channel < 16; channel++)
+        portPanic(OUTPORTS[i], channel);
+  return true;
+}
+bool controlSend(int port) {
+  if (port < -1 || port >= (int)OUTPORTS.size()) return false;
+  std::lock_guard<std::mutex> lock(ENGINE_MUTEX);
+  for (size_t i = 0; i < OUTPORTS.size(); i++)
+    if (port < 0 || (int)i == port) OUTPORTS[i]->synth->sendVoice();
+  return true;
+}
+void publishState() {
+  long long now = getMicros();
+  STATE_LINK L;
+  for (size_t i = 0; i < OUTPORTS.size(); i++) {
+    STATE_PORT *S = statePort(i);
+    if (!S) break;
+    OUTPORT *P = OUTPORTS[i];
+    memset(&L, 0, sizeof(L));
+    strncpy(L.name, P->NAME.c_str(), sizeof(L.name) - 1);
+    {
+      std::lock_guard<std::mutex> lk(P->lock);
+      L.depth = P->notes.count + P->params.count;
+      L.maxDepth = P->maxDepth;
+      L.queued = P->queued;
+      L.sent = P->sent;
+      L.bytes = P->bytes;
+      L.dropped = P->dropped;
+      L.errors = P->errors;
+    }
+    L.exists = P->EXISTS;
+    L.rate = P->RATE;
+    unsigned long wire = L.bytes + P->forwardedBytes; // all the link carried
+    if (P->pubUs && now > P->pubUs)
+      L.bytesPerSec = (wire - P->pubBytes) * 1000000LL / (now - P->pubUs);
+    if (P->RATE > 0) L.utilisation = L.bytesPerSec * 1000LL / P->RATE;
+    P->pubBytes = wire;
+    P->pubUs = now;
+    stateLink(S, L);
+  }
+}
+void linkRefill(OUTPORT *P) {
+  long long now = getMicros();
+  P->linkTokens += (now - P->linkStamp) * P->RATE;
+  P->linkTokens -= P->forwardLink.exchange(0) * 1000000LL;
+  P->linkStamp = now;
+  if (P->linkTokens > LINK_BURST * 1000000LL) P->linkTokens = LINK_BURST * 1000000LL;
+}
+void linkSpend(OUTPORT *P, int bytes) {
+  if (P->RATE == 0) return;
+  linkRefill(P);
+  P->linkTokens -= bytes * 1000000LL;
+}
+bool linkHasRoom(OUTPORT *P, int bytes) {
+  if (P->RATE == 0) return true;
+  linkRefill(P);
+  return P->linkTokens >= (bytes + LINK_RESERVE) * 1000000LL;
+}
+
+RENDER_TIME::RENDER_TIME(int division) : division(division) {
+  smpte = (division & 0x8000) != 0;
+  if (smpte) { // frames per second (as a negative byte) x ticks per frame
+    int fps = -(signed char)(division >> 8);
+    int tpf = division & 0xFF;
+    perTick = 1000000LL / max(1, fps * tpf);
+  } else {
+    perTick = 500000; // 120 BPM until told otherwise
+  }
+}
+long long RENDER_TIME::toUs(unsigned long tick) {
+  long long ticks = tick - anchorTick;
+  if (smpte) return anchorUs + ticks * perTick;
+  return anchorUs + ticks * perTick / max(1, division);
+}
+unsigned long RENDER_TIME::toTick(long long us) {
+  if (us <= anchorUs) return anchorTick;
+  long long scaled = (us - anchorUs) * (smpte ? 1 : max(1, division));
+  return anchorTick + (scaled + perTick - 1) / perTick;
+}
+void RENDER_TIME::setTempo(unsigned long tick, long long usPerQuarter) {
+  if (smpte || usPerQuarter <= 0) return;
+  anchorUs = toUs(tick);
+  anchorTick = tick;
+  perTick = usPerQuarter;
+}
+
+bool renderFile(OUTPORT *P, const string &in, const string &out) {
+  SMF_READER R;
+  SMF_WRITER W;
+  if (!R.open(in) || !W.open(out, R.division)) return false;
+  RENDER_TIME T(R.division);
+  SMF_EVENT ev;
+  vector<unsigned char> message; // reused, onMIDI() takes a vector
+  message.reserve(256);
+  long long wire = 0; // when the simulated link is next free
+  RENDER_CLOCK = 0;
+  while (R.next(ev)) {
+    long long us = T.toUs(ev.tick);
+    renderDrain(P, W, T, wire, us); // what the link got out before now
+    RENDER_CLOCK = us;
+    switch (ev.kind) {
+      case SMF_META:
+        W.meta(ev.tick, ev.type, ev.data, ev.size);
+        if (ev.type == 0x51 && ev.size == 3)
+          T.setTempo(ev.tick, (ev.data[0] << 16) | (ev.data[1] << 8) | ev.data[2]);
+        continue;
+      case SMF_ESCAPE:
+        W.escape(ev.tick, ev.data, ev.size);
+        continue;
+      case SMF_SYSEX:
+        message.assign(1, 0xF0);
+        message.insert(message.end(), ev.data, ev.data + ev.size);
+        break;
+      default:
+        message.assign(ev.data, ev.data + ev.size);
+    }
+    onMIDI(0, &message, 0);
+    serviceMods();
+    renderDrain(P, W, T, wire, us);
+  }
+  // Let any held back modulation out, then run the link dry.
+  RENDER_CLOCK += 1000000;
+  serviceMods();
+  renderDrain(P, W, T, wire, LLONG_MAX);
+  RENDER_CLOCK = -1;
+  return W.close();
+}
+
+void renderDrain(OUTPORT *P, SMF_WRITER &W, RENDER_TIME &T, long long &wire,
+                 long long until) {
+  vector<unsigned char> out;
+  long long stamp;
+  while (P->notes.count || P->params.count) {
+    // Anything still queued was queued by RENDER_CLOCK at the latest.
+    if (wire < RENDER_CLOCK) wire = RENDER_CLOCK;
+    if (wire > until) return;
+    (P->notes.count ? P->notes : P->params).pop(out, stamp);
+    // Start on the tick grid so the spacing survives quantisation.
+    unsigned long tick = T.toTick(wire);
+    wire = max(wire, T.toUs(tick));
+    W.message(tick, out.data(), out.size());
+    P->sent++;
+    P->bytes += out.size();
+    if (P->RATE > 0) wire += out.size() * 1000000LL / P->RATE;
+  }
+}
+
+long long getMicros() {
+  if (RENDER_CLOCK >= 0) return RENDER_CLOCK;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+      .count();
+}
 long long getSecs() // gets time since epch in seconds
 {
   auto t1 = std::chrono::system_clock::now();
@@ -694,75 +1477,10 @@ long long getSecs() // gets time since epch in seconds
   return us;
 }
 void signalHandler(int signum) {
-  cout << "Interrupt signal (" << signum << ") received.\n";
-  cout << "Process txsex Terminiated!" << endl;
-  cleanup();
-}
-
-void updateAlgos(int algo) {
-  // Clear all envelope lists for carriers and modulators
-  ATTACK.CARRIERS.clear();
-  DECAY.CARRIERS.clear();
-  SUSTAIN.CARRIERS.clear();
-  RELEASE.CARRIERS.clear();
-  ATTACK.MODULATORS.clear();
-  DECAY.MODULATORS.clear();
-  SUSTAIN.MODULATORS.clear();
-  RELEASE.MODULATORS.clear();
-  ATTACK.LCARRIERS.clear();
-  DECAY.LCARRIERS.clear();
-  SUSTAIN.LCARRIERS.clear();
-  RELEASE.LCARRIERS.clear();
-  ATTACK.LMODULATORS.clear();
-  DECAY.LMODULATORS.clear();
-  SUSTAIN.LMODULATORS.clear();
-  RELEASE.LMODULATORS.clear();
-
-  // Base CC numbers for TX-81Z operator parameters
-  // Operators mapped to: OP4=CC67, OP3=CC80, OP2=CC93, OP1=CC106
-  struct {
-    int ATTACK = 67;  // Base CC for Attack Rate (AR)
-    int DECAY1 = 68;  // Base CC for Decay 1 Rate (D1R)
-    int DECAY2 = 69;  // Base CC for Decay 2 Rate (D2R)
-    int RELEASE = 70; // Base CC for Release Rate (RR)
-    int D1LEVEL = 71; // Base CC for Decay 1 Level (D1L)
-    int OUTPUT = 72;  // Base CC for Output Level
-  } index;
-
-  // Each operator block is now 13 CCs apart (67, 80, 93, 106)
-  const int OP_SPACING = 13;
-
-  // Loop through 4 operators
-  // i=1 maps to OP4 (CC 67+), i=2 to OP3 (CC 80+), i=3 to OP2 (CC 93+), i=4 to
-  // OP1 (CC 106+)
-  for (int i = 1; i <= 4; i++) {
-    int opOffset = (i - 1) * OP_SPACING;
-
-    if (isSet(ALGOS[algo], i)) {
-      // This operator is a CARRIER (produces audible output)
-      ATTACK.CARRIERS.push_back(index.ATTACK + opOffset);
-      DECAY.CARRIERS.push_back(index.DECAY1 + opOffset);
-      SUSTAIN.CARRIERS.push_back(index.DECAY2 + opOffset);
-      RELEASE.CARRIERS.push_back(index.RELEASE + opOffset);
-
-      // Level parameters (D1L as attack level, OUTPUT as sustain level)
-      ATTACK.LCARRIERS.push_back(index.D1LEVEL + opOffset);
-      DECAY.LCARRIERS.push_back(index.D1LEVEL + opOffset);
-      SUSTAIN.LCARRIERS.push_back(index.OUTPUT + opOffset);
-      RELEASE.LCARRIERS.push_back(index.OUTPUT + opOffset);
-    } else {
-      // This operator is a MODULATOR (modulates other operators)
-      ATTACK.MODULATORS.push_back(index.ATTACK + opOffset);
-      DECAY.MODULATORS.push_back(index.DECAY1 + opOffset);
-      SUSTAIN.MODULATORS.push_back(index.DECAY2 + opOffset);
-      RELEASE.MODULATORS.push_back(index.RELEASE + opOffset);
-
-      ATTACK.LMODULATORS.push_back(index.D1LEVEL + opOffset);
-      DECAY.LMODULATORS.push_back(index.D1LEVEL + opOffset);
-      SUSTAIN.LMODULATORS.push_back(index.OUTPUT + opOffset);
-      RELEASE.LMODULATORS.push_back(index.OUTPUT + opOffset);
-    }
+  if (signum == SIGUSR1) {
+    statsRequested = 1;
+    return;
   }
+  // The output workers are joined from the main loop, not from here.
+  stopRequested = 1;
 }
-
-bool isSet(int n, int k) { return ((n & (1 << (k - 1))) > 0); }
@@ -0,0 +1,135 @@
+/*******************************************************************
+perf_event_open counters for txsex. See perf.h.
+*****************************************************************/
+#include "perf.h"
+
+#ifdef TXSEX_PERF
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+using namespace std;
+
+static const char *STAGE_NAMES[PERF_STAGES] = { "input", "translate", "output" };
+static const char *COUNTER_NAMES[PERF_COUNTERS] = { "cycles", "instructions",
+                                                    "cache-misses",
+                                                    "branch-misses" };
+static const uint64_t COUNTER_CONFIG[PERF_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+struct PERF_TOTAL {
+  std::atomic<uint64_t> events{0};
+  std::atomic<uint64_t> counts[PERF_COUNTERS];
+  PERF_TOTAL() {
+    for (int i = 0; i < PERF_COUNTERS; i++) counts[i] = 0;
+  }
+};
+static PERF_TOTAL TOTALS[PERF_STAGES];
+static std::atomic<bool> counterMissing[PERF_COUNTERS];
+static std::atomic<bool> warned{false};
+
+// One counter group per thread, read with a single read() per sample.
+// Counters this CPU does not have are left out of the group.
+struct PERF_GROUP {
+  int leader = -1;
+  int nr = 0;                  // counters in the group
+  int slot[PERF_COUNTERS];     // position in the read, -1 when missing
+  bool tried = false;
+
+  ~PERF_GROUP() {
+    if (leader >= 0) close(leader); // the members go with it
+  }
+
+  bool open() {
+    tried = true;
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+      slot[i] = -1;
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = COUNTER_CONFIG[i];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = leader < 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      int fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+      if (fd < 0) {
+        if (leader < 0) { // no cycles counter, no group
+          if (!warned.exchange(true))
+            cout << "txsex => perf counters unavailable: " << strerror(errno)
+                 << (errno == EACCES || errno == EPERM
+                         ? " (see /proc/sys/kernel/perf_event_paranoid)"
+                         : "")
+                 << endl;
+          return false;
+        }
+        counterMissing[i] = true;
+        continue;
+      }
+      if (leader < 0) leader = fd;
+      slot[i] = nr++;
+    }
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+  }
+
+  bool sample(uint64_t *values) {
+    if (!tried) open();
+    if (leader < 0) return false;
+    uint64_t buf[1 + PERF_COUNTERS];
+    if (read(leader, buf, sizeof(uint64_t) * (1 + nr)) <= 0) return false;
+    for (int i = 0; i < PERF_COUNTERS; i++)
+      values[i] = slot[i] >= 0 ? buf[1 + slot[i]] : 0;
+    return true;
+  }
+};
+static thread_local PERF_GROUP GROUP;
+
+PERF_SCOPE::PERF_SCOPE(PERF_STAGE stage, uint64_t messages)
+    : stage(stage), messages(messages) {
+  on = GROUP.sample(start);
+}
+
+PERF_SCOPE::~PERF_SCOPE() {
+  if (!on) return;
+  uint64_t end[PERF_COUNTERS];
+  if (!GROUP.sample(end)) return;
+  PERF_TOTAL &T = TOTALS[stage];
+  T.events.fetch_add(messages, std::memory_order_relaxed);
+  for (int i = 0; i < PERF_COUNTERS; i++)
+    T.counts[i].fetch_add(end[i] - start[i], std::memory_order_relaxed);
+}
+
+void perfReport(ostream &out) {
+  streamsize precision = out.precision();
+  for (int s = 0; s < PERF_STAGES; s++) {
+    uint64_t events = TOTALS[s].events.load(std::memory_order_relaxed);
+    if (!events) continue;
+    uint64_t c[PERF_COUNTERS];
+    for (int i = 0; i < PERF_COUNTERS; i++)
+      c[i] = TOTALS[s].counts[i].load(std::memory_order_relaxed);
+    out << "txsex => perf " << STAGE_NAMES[s] << ": " << events
+        << " messages, per message";
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+      out << " " << COUNTER_NAMES[i] << " ";
+      if (counterMissing[i]) out << "n/a";
+      else out << fixed << setprecision(1) << (double)c[i] / events;
+    }
+    if (c[0] && !counterMissing[1])
+      out << ", IPC " << setprecision(2) << (double)c[1] / c[0];
+    out << endl;
+    out.unsetf(ios::floatfield);
+    out.precision(precision);
+  }
+}
+
+#endif
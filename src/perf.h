@@ -0,0 +1,53 @@
+/*******************************************************************
+Hardware performance counters around the txsex pipeline.
+
+Built with -DTXSEX_PERF (cmake -DTXSEX_PERF=ON), each stage below counts
+user space cycles, instructions, cache misses and branch misses through
+perf_event_open, on whatever thread runs it. The stages are:
+
+  PERF_INPUT      the input callback: stamping and queueing a batch
+  PERF_TRANSLATE  onMIDI() on the merge thread: MAP lookup, dedup, sysex
+  PERF_OUTPUT     one sendMessage() on a port worker
+
+Totals are printed with the port statistics (on exit and on SIGUSR1)
+as per message averages; a scope over a batch counts as its size.
+Without TXSEX_PERF, PERF_SCOPE is an empty
+struct and costs nothing.
+*****************************************************************/
+#ifndef TXSEX_PERF_H
+#define TXSEX_PERF_H
+
+#include <cstdint>
+#include <ostream>
+
+enum PERF_STAGE { PERF_INPUT, PERF_TRANSLATE, PERF_OUTPUT, PERF_STAGES };
+
+#ifdef TXSEX_PERF
+
+const int PERF_COUNTERS = 4; // cycles, instructions, cache and branch misses
+
+// Counts the enclosing block against a stage, as 'messages' messages.
+class PERF_SCOPE {
+public:
+  explicit PERF_SCOPE(PERF_STAGE stage, uint64_t messages = 1);
+  ~PERF_SCOPE();
+
+private:
+  PERF_STAGE stage;
+  uint64_t messages;
+  bool on;
+  uint64_t start[PERF_COUNTERS];
+};
+
+void perfReport(std::ostream &out);
+
+#else
+
+struct PERF_SCOPE {
+  explicit PERF_SCOPE(PERF_STAGE, uint64_t = 1) {}
+};
+inline void perfReport(std::ostream &) {}
+
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+/*******************************************************************
+Synth profiles for txsex: everything that differs between the 4-op
+(TX81Z, DX21/27/100) and 6-op (DX7, Volca FM, Dexed) Yamaha synths.
+
+A profile is a plain struct of static tables and functions. The engine
+in synth.h is a template over the profile, so the per-message path is
+compiled separately for each synth and never asks which one it is.
+*****************************************************************/
+#ifndef TXSEX_PROFILES_H
+#define TXSEX_PROFILES_H
+
+#include <cstddef>
+
+enum BPOS {
+  GROUP = 3,
+  PARAMETER = 4,
+  DATA = 5
+
+};
+enum CCTYPES { SYSTEM, SYSEX, SKIP, CC, MACRO };
+
+struct CC_MAPPING {
+  //  int x = 0;
+  CC_MAPPING(CCTYPES TYPE, int CC, int MIN, int MAX, int GROUP, int PARAMETER)
+      : TYPE(TYPE), CC(CC), MIN(MIN), MAX(MAX), GROUP(GROUP),
+        PARAMETER(PARAMETER) {};
+  CCTYPES TYPE = SKIP;
+  int CC = 0;
+  int MIN = 0;
+  int MAX = 99;
+  int GROUP = 0;
+  int PARAMETER = 0;
+};
+
+// Where translated bytes go. ctx is whatever the caller registered.
+typedef void (*EMIT)(void *ctx, const unsigned char *message, size_t size);
+
+// Yamaha parameter change: F0 43 1n gggggghh 0ppppppp 0ddddddd F7.
+// The two high bits of a parameter number > 127 ride in the group byte.
+inline size_t yamahaParamChange(unsigned char *out, int group, int parameter,
+                                int value) {
+  out[0] = 0xF0;
+  out[1] = 0x43;
+  out[2] = 0x10;
+  out[BPOS::GROUP] = (unsigned char)(group | (parameter >> 7));
+  out[BPOS::PARAMETER] = (unsigned char)(parameter & 0x7F);
+  out[BPOS::DATA] = (unsigned char)value;
+  out[6] = 0xF7;
+  return 7;
+}
+
+// Yamaha bulk dump: F0 43 0n ff bb bb <header><data> cs F7, where the
+// byte count and checksum both cover header + data.
+void yamahaBulk(EMIT emit, void *ctx, unsigned char format,
+                const char *header, const unsigned char *data, int size);
+// The reverse: copies the data of a dump with this format and header
+// (any channel) into data. False on a mismatch or bad checksum.
+bool yamahaUnbulk(const unsigned char *message, size_t length,
+                  unsigned char format, const char *header,
+                  unsigned char *data, int size);
+
+struct TX81Z {
+  static const char *NAME;
+  static const int OPS = 4;
+  static const int ALGO_COUNT = 8;
+  // VCED 0-93 (93 is op on/off, not part of the dump), then ACED 0-22
+  static const int VOICE_SIZE = 94 + 23;
+  static const CC_MAPPING MAP[128];
+  static const int ALGOS[ALGO_COUNT];
+  static const int EG_RATE[4];  // attack, decay, sustain, release
+  static const int EG_LEVEL[4];
+
+  // OP4 is the first block (CC 67), OP1 the last (CC 106)
+  static int opCC(int op) { return 67 + (OPS - op) * 13; }
+  static int slot(int group, int parameter) {
+    return group == 19 ? 94 + parameter : parameter;
+  }
+  static size_t frame(unsigned char *out, int group, int parameter, int value) {
+    return yamahaParamChange(out, group, parameter, value);
+  }
+  static void bulk(const unsigned char *voice, EMIT emit, void *ctx);
+  static bool unbulk(unsigned char *voice, const unsigned char *message, size_t size);
+};
+
+struct DX7 {
+  static const char *NAME;
+  static const int OPS = 6;
+  static const int ALGO_COUNT = 32;
+  // VCED 0-155 (155 is op on/off, not part of the dump)
+  static const int VOICE_SIZE = 156;
+  static const CC_MAPPING MAP[128];
+  static const int ALGOS[ALGO_COUNT];
+  static const int EG_RATE[4];
+  static const int EG_LEVEL[4];
+
+  // OP6-OP4 sit below the sustain/sostenuto CCs, OP3-OP1 above them
+  static int opCC(int op) { return op > 3 ? 20 + (6 - op) * 13 : 67 + (3 - op) * 13; }
+  static int slot(int /*group*/, int parameter) { return parameter; }
+  static size_t frame(unsigned char *out, int group, int parameter, int value) {
+    return yamahaParamChange(out, group, parameter, value);
+  }
+  static void bulk(const unsigned char *voice, EMIT emit, void *ctx);
+  static bool unbulk(unsigned char *voice, const unsigned char *message, size_t size);
+};
+
+#endif
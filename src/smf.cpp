@@ -0,0 +1,274 @@
+/*******************************************************************
+Standard MIDI File reader and writer for txsex. See smf.h.
+*****************************************************************/
+#include "smf.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+const size_t SMF_BUFFER = 64 * 1024; // writer buffer
+
+static unsigned long be32(const unsigned char *p) {
+  return ((unsigned long)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Reads a variable length quantity, at most 4 bytes and never past end.
+static inline bool readVLQ(const unsigned char *&p, const unsigned char *end,
+                           unsigned long &value) {
+  value = 0;
+  for (int i = 0; i < 4 && p < end; i++) {
+    unsigned char b = *p++;
+    value = (value << 7) | (b & 0x7F);
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+bool SMF_READER::open(const string &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    cout << "txsex => Could not open " << path << endl;
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+  mapSize = st.st_size;
+  void *mem = mapSize >= 14 ? mmap(0, mapSize, PROT_READ, MAP_PRIVATE, fd, 0)
+                            : MAP_FAILED;
+  ::close(fd);
+  if (mem == MAP_FAILED || memcmp(mem, "MThd", 4) != 0 ||
+      be32((const unsigned char *)mem + 4) < 6) {
+    cout << "txsex => " << path << " is not a Standard MIDI File" << endl;
+    if (mem != MAP_FAILED) munmap(mem, mapSize);
+    mapSize = 0;
+    return false;
+  }
+  map = static_cast<const unsigned char *>(mem);
+  madvise((void *)map, mapSize, MADV_SEQUENTIAL);
+
+  format = (map[8] << 8) | map[9];
+  int count = (map[10] << 8) | map[11];
+  division = (map[12] << 8) | map[13];
+
+  // Find every MTrk, skipping any chunk type we do not know. A truncated
+  // last track is read as far as it goes.
+  size_t at = 8 + be32(map + 4);
+  while ((int)tracks.size() < count && at + 8 <= mapSize) {
+    size_t size = be32(map + at + 4);
+    if (memcmp(map + at, "MTrk", 4) == 0) {
+      TRACK T;
+      T.p = map + at + 8;
+      T.end = map + min(mapSize, at + 8 + size);
+      tracks.push_back(T);
+    }
+    at += 8 + size;
+  }
+  if ((int)tracks.size() < count)
+    cout << "txsex => " << path << ": only " << tracks.size() << " of "
+         << count << " tracks found" << endl;
+  for (size_t t = 0; t < tracks.size(); t++) decode(tracks[t]);
+  return true;
+}
+
+void SMF_READER::close() {
+  if (map) munmap((void *)map, mapSize);
+  map = 0;
+  mapSize = 0;
+  tracks.clear();
+}
+
+bool SMF_READER::next(SMF_EVENT &ev) {
+  int first = -1;
+  for (size_t t = 0; t < tracks.size(); t++) {
+    if (!tracks[t].ready) continue;
+    if (first == -1 || tracks[t].pending.tick < tracks[first].pending.tick)
+      first = t;
+  }
+  if (first == -1) return false;
+  TRACK &T = tracks[first];
+  ev = T.pending;
+  ev.track = first;
+  if (ev.kind == SMF_CHANNEL) ev.data = ev.message; // not T's copy
+  decode(T);
+  return true;
+}
+
+// Reads the next event of T into its pending slot.
+bool SMF_READER::decode(TRACK &T) {
+  SMF_EVENT &E = T.pending;
+  T.ready = false;
+
+  unsigned long delta, length;
+  if (!readVLQ(T.p, T.end, delta) || T.p >= T.end) return false;
+  T.tick += delta;
+  E.tick = T.tick;
+  unsigned char b = *T.p++;
+
+  if (b == 0xFF) {
+    if (T.p >= T.end) return false;
+    E.type = *T.p++;
+    if (!readVLQ(T.p, T.end, length) || length > (size_t)(T.end - T.p))
+      return false;
+    E.kind = SMF_META;
+    E.data = T.p;
+    E.size = length;
+    T.p += length;
+    if (E.type == 0x2F) return false; // End of Track
+  } else if (b == 0xF0 || b == 0xF7) {
+    if (!readVLQ(T.p, T.end, length) || length > (size_t)(T.end - T.p))
+      return false;
+    E.kind = b == 0xF0 ? SMF_SYSEX : SMF_ESCAPE;
+    E.data = T.p;
+    E.size = length;
+    T.p += length;
+    T.running = 0; // sysex cancels running status
+  } else {
+    if (b & 0x80) {
+      T.running = b;
+      if (T.p >= T.end) return false;
+      b = *T.p++;
+    } else if (!T.running) {
+      return false; // data byte with no status: corrupt
+    }
+    E.kind = SMF_CHANNEL;
+    E.message[0] = T.running;
+    E.message[1] = b;
+    E.size = 2;
+    unsigned char typ = T.running & 0xF0;
+    if (typ != 0xC0 && typ != 0xD0) {
+      if (T.p >= T.end) return false;
+      E.message[2] = *T.p++;
+      E.size = 3;
+    }
+    E.data = E.message;
+  }
+  T.ready = true;
+  return true;
+}
+
+bool SMF_WRITER::open(const string &path, int division) {
+  close();
+  file = fopen(path.c_str(), "wb");
+  if (!file) {
+    cout << "txsex => Could not create " << path << endl;
+    return false;
+  }
+  buf.resize(SMF_BUFFER);
+  used = 0;
+  const unsigned char header[] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1,
+                                   (unsigned char)(division >> 8),
+                                   (unsigned char)division,
+                                   'M', 'T', 'r', 'k', 0, 0, 0, 0 };
+  fwrite(header, 1, sizeof(header), file);
+  trackStart = sizeof(header);
+  length = 0;
+  last = 0;
+  running = 0;
+  return true;
+}
+
+void SMF_WRITER::message(unsigned long tick, const unsigned char *data,
+                         size_t size) {
+  if (!file || size == 0) return;
+  delta(tick);
+  if (data[0] == 0xF0) {
+    unsigned char f0 = 0xF0;
+    bytes(&f0, 1);
+    vlq(size - 1);
+    bytes(data + 1, size - 1);
+    running = 0;
+    return;
+  }
+  if (data[0] >= 0xF0) { // system common/realtime: no running status
+    running = 0;
+    bytes(data, size);
+    return;
+  }
+  if (data[0] == running) {
+    bytes(data + 1, size - 1);
+    return;
+  }
+  running = data[0];
+  bytes(data, size);
+}
+
+void SMF_WRITER::meta(unsigned long tick, unsigned char type,
+                      const unsigned char *data, size_t size) {
+  if (!file) return;
+  delta(tick);
+  unsigned char head[2] = { 0xFF, type };
+  bytes(head, 2);
+  vlq(size);
+  bytes(data, size);
+  running = 0;
+}
+
+void SMF_WRITER::escape(unsigned long tick, const unsigned char *data,
+                        size_t size) {
+  if (!file) return;
+  delta(tick);
+  unsigned char f7 = 0xF7;
+  bytes(&f7, 1);
+  vlq(size);
+  bytes(data, size);
+  running = 0;
+}
+
+bool SMF_WRITER::close() {
+  if (!file) return false;
+  meta(last, 0x2F, 0, 0);
+  flush();
+  unsigned char size[4] = { (unsigned char)(length >> 24),
+                            (unsigned char)(length >> 16),
+                            (unsigned char)(length >> 8),
+                            (unsigned char)length };
+  fseek(file, trackStart - 4, SEEK_SET);
+  fwrite(size, 1, 4, file);
+  bool ok = !ferror(file);
+  fclose(file);
+  file = 0;
+  return ok;
+}
+
+void SMF_WRITER::delta(unsigned long tick) {
+  if (tick < last) tick = last; // never go back in time
+  vlq(tick - last);
+  last = tick;
+}
+
+// Encodes straight into the buffer: at most 4 bytes, high group first.
+void SMF_WRITER::vlq(unsigned long value) {
+  if (value > 0x0FFFFFFF) value = 0x0FFFFFFF;
+  if (used + 4 > buf.size()) flush();
+  unsigned char *out = &buf[used];
+  int n = value >= 1 << 21 ? 4 : value >= 1 << 14 ? 3 : value >= 1 << 7 ? 2 : 1;
+  for (int i = n - 1; i >= 0; i--)
+    *out++ = (unsigned char)(((value >> (7 * i)) & 0x7F) | (i ? 0x80 : 0));
+  used += n;
+  length += n;
+}
+
+void SMF_WRITER::bytes(const unsigned char *data, size_t size) {
+  if (!size) return;
+  length += size;
+  if (used + size > buf.size()) {
+    flush();
+    if (size > buf.size()) { // bigger than the buffer, write it through
+      fwrite(data, 1, size, file);
+      return;
+    }
+  }
+  memcpy(&buf[used], data, size);
+  used += size;
+}
+
+void SMF_WRITER::flush() {
+  if (used) fwrite(buf.data(), 1, used, file);
+  used = 0;
+}
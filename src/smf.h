@@ -0,0 +1,86 @@
+/*******************************************************************
+Standard MIDI File reading and writing for txsex.
+
+SMF_READER maps the whole file and walks every track at once, handing
+events back merged in tick order (ties go to the lower track). Events
+point straight into the mapping; nothing is copied or allocated per
+event, so multi-megabyte files parse about as fast as they can be paged
+in. SMF_WRITER writes a format 0 file through its own buffer, with
+running status.
+*****************************************************************/
+#ifndef TXSEX_SMF_H
+#define TXSEX_SMF_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum SMF_KIND { SMF_CHANNEL, SMF_SYSEX, SMF_ESCAPE, SMF_META };
+
+struct SMF_EVENT {
+  unsigned long tick = 0; // absolute
+  int track = 0;
+  SMF_KIND kind = SMF_CHANNEL;
+  unsigned char type = 0; // meta type
+  // SMF_CHANNEL: the whole message, status restored (points at message).
+  // SMF_SYSEX: the body after F0, up to and including its F7.
+  // SMF_ESCAPE: the raw bytes of an F7 event. SMF_META: the payload.
+  // Valid until the reader is closed.
+  const unsigned char *data = 0;
+  size_t size = 0;
+  unsigned char message[3];
+};
+
+class SMF_READER {
+public:
+  ~SMF_READER() { close(); }
+  bool open(const std::string &path);
+  void close();
+  bool next(SMF_EVENT &ev); // false at the end of the last track
+
+  int format = 0;
+  int division = 96; // ticks per quarter, or SMPTE when bit 15 is set
+
+private:
+  struct TRACK {
+    const unsigned char *p = 0, *end = 0; // the undecoded rest
+    unsigned long tick = 0;
+    unsigned char running = 0;
+    bool ready = false; // pending holds the next event
+    SMF_EVENT pending;
+  };
+  bool decode(TRACK &T);
+
+  const unsigned char *map = 0;
+  size_t mapSize = 0;
+  std::vector<TRACK> tracks;
+};
+
+class SMF_WRITER {
+public:
+  ~SMF_WRITER() { close(); }
+  bool open(const std::string &path, int division);
+  // A complete channel message or F0 .. F7 sysex
+  void message(unsigned long tick, const unsigned char *data, size_t size);
+  void meta(unsigned long tick, unsigned char type, const unsigned char *data,
+            size_t size);
+  // An F7 event: raw bytes for the wire, eg sysex split into packets
+  void escape(unsigned long tick, const unsigned char *data, size_t size);
+  // Writes End of Track and fills in the track length.
+  bool close();
+
+private:
+  void delta(unsigned long tick);
+  void vlq(unsigned long value);
+  void bytes(const unsigned char *data, size_t size);
+  void flush();
+
+  FILE *file = 0;
+  long trackStart = 0;
+  unsigned long length = 0, last = 0;
+  unsigned char running = 0;
+  std::vector<unsigned char> buf;
+  size_t used = 0;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*******************************************************************
+Shared memory state publication for txsex. See state.h.
+*****************************************************************/
+#include "state.h"
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+using namespace std;
+
+static STATE_SEGMENT *segment = 0;
+static string segmentName;
+
+static uint64_t stateMicros() {
+  return chrono::duration_cast<chrono::microseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Odd while the half is being rewritten
+static inline void beginWrite(std::atomic<uint32_t> &seq) {
+  seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+static inline void endWrite(std::atomic<uint32_t> &seq) {
+  seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool startState(const string &name, int ports) {
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(STATE_SEGMENT)) < 0) {
+    cout << "txsex => Could not create shared memory " << name << ": "
+         << strerror(errno) << endl;
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  void *mem = mmap(0, sizeof(STATE_SEGMENT), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) return false;
+  segment = static_cast<STATE_SEGMENT *>(mem);
+  segment->magic = 0;
+  memset((void *)segment->port, 0, sizeof(segment->port));
+  if (ports > STATE_MAX_PORTS) {
+    cout << "txsex => Only the first " << STATE_MAX_PORTS
+         << " outputs are published to " << name << endl;
+    ports = STATE_MAX_PORTS;
+  }
+  segment->ports = ports;
+  std::atomic_thread_fence(std::memory_order_release);
+  segment->magic = STATE_MAGIC;
+  segmentName = name;
+  cout << "txsex => Publishing state to: " << name << endl;
+  return true;
+}
+
+void stopState() {
+  if (!segment) return;
+  segment->magic = 0;
+  munmap(segment, sizeof(STATE_SEGMENT));
+  shm_unlink(segmentName.c_str());
+  segment = 0;
+}
+
+STATE_PORT *statePort(int index) {
+  if (!segment || index < 0 || index >= (int)segment->ports) return 0;
+  return &segment->port[index];
+}
+
+void stateVoice(STATE_PORT *S, int slot, unsigned char value) {
+  if (slot < 0 || slot >= STATE_VOICE_SLOTS) return;
+  uint64_t now = stateMicros();
+  beginWrite(S->voiceSeq);
+  S->voice.data[slot] = value;
+  S->voice.stamp[slot] = now;
+  endWrite(S->voiceSeq);
+}
+
+void stateImage(STATE_PORT *S, const char *profile, const unsigned char *voice,
+                int size, bool sent) {
+  if (size > STATE_VOICE_SLOTS) size = STATE_VOICE_SLOTS;
+  uint64_t now = sent ? stateMicros() : 0;
+  beginWrite(S->voiceSeq);
+  strncpy(S->voice.profile, profile, sizeof(S->voice.profile) - 1);
+  S->voice.size = size;
+  memcpy(S->voice.data, voice, size);
+  for (int i = 0; i < size; i++) S->voice.stamp[i] = now;
+  endWrite(S->voiceSeq);
+}
+
+void stateLink(STATE_PORT *S, const STATE_LINK &link) {
+  beginWrite(S->linkSeq);
+  S->link = link;
+  S->link.stamp = stateMicros();
+  endWrite(S->linkSeq);
+}
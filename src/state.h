@@ -0,0 +1,80 @@
+/*******************************************************************
+Live state for UI clients. With -state <name> (eg /txsex-state) txsex
+keeps a POSIX shared memory segment up to date with what it has sent to
+every output: the voice image as the synth now holds it, when each
+parameter last changed, and the port's queue and link figures.
+
+Each half of a STATE_PORT sits behind its own sequence lock. A reader
+copies the half out, and keeps the copy only if the sequence number was
+even and unchanged across it (see stateRead below). Readers never block
+txsex; at worst they retry.
+*****************************************************************/
+#ifndef TXSEX_STATE_H
+#define TXSEX_STATE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+const uint32_t STATE_MAGIC = 0x54585331; // "TXS1"
+const int STATE_MAX_PORTS = 8;
+const int STATE_VOICE_SLOTS = 256;
+
+struct STATE_VOICE {
+  char profile[16]; // "tx81z", "dx7"
+  uint32_t size;    // slots in use, the profile's VOICE_SIZE
+  uint8_t data[STATE_VOICE_SLOTS];
+  // CLOCK_MONOTONIC microseconds of the last change, 0 = never sent
+  uint64_t stamp[STATE_VOICE_SLOTS];
+};
+
+struct STATE_LINK {
+  char name[64];
+  uint32_t exists;      // 0 while unplugged
+  uint32_t rate;        // pacing in bytes/second, 0 = unpaced
+  uint32_t depth;       // messages waiting now
+  uint32_t maxDepth;
+  uint32_t bytesPerSec; // over the last publish interval
+  uint32_t utilisation; // per mille of rate, 0 when unpaced
+  uint64_t queued, sent, bytes, dropped, errors;
+  uint64_t stamp; // CLOCK_MONOTONIC microseconds of this snapshot
+};
+
+struct STATE_PORT {
+  alignas(64) std::atomic<uint32_t> voiceSeq;
+  STATE_VOICE voice;
+  alignas(64) std::atomic<uint32_t> linkSeq;
+  STATE_LINK link;
+};
+
+struct STATE_SEGMENT {
+  uint32_t magic; // written last, once the segment is ready
+  uint32_t ports; // STATE_PORTs in use
+  STATE_PORT port[STATE_MAX_PORTS];
+};
+
+// Reader side: copy one half out consistently.
+template <class T>
+inline void stateRead(const std::atomic<uint32_t> &seq, const T &src, T &dst) {
+  uint32_t before, after;
+  do {
+    before = seq.load(std::memory_order_acquire);
+    memcpy(&dst, &src, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = seq.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+}
+
+// Writer side. Voice updates come from the engine under ENGINE_MUTEX,
+// link updates from the main loop, so each half has a single writer.
+bool startState(const std::string &name, int ports);
+void stopState();
+STATE_PORT *statePort(int index); // 0 when not publishing that port
+void stateVoice(STATE_PORT *S, int slot, unsigned char value);
+// The whole image at once; sent is false for the power-on image.
+void stateImage(STATE_PORT *S, const char *profile, const unsigned char *voice,
+                int size, bool sent);
+void stateLink(STATE_PORT *S, const STATE_LINK &link);
+
+#endif
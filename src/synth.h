@@ -0,0 +1,178 @@
+/*******************************************************************
+Per-output translation engine. One SYNTH lives on every output port and
+owns that synth's dedup state, envelope macro tables and voice image.
+The profile is picked at runtime (makeSynth), but the translation
+itself is SYNTH_ENGINE<PROFILE>, specialised at compile time.
+*****************************************************************/
+#ifndef TXSEX_SYNTH_H
+#define TXSEX_SYNTH_H
+
+#include <string>
+#include <vector>
+#include "profiles.h"
+#include "state.h"
+
+struct ENVS {
+  std::vector<int> CARRIERS;
+  std::vector<int> LCARRIERS;
+  std::vector<int> MODULATORS;
+  std::vector<int> LMODULATORS;
+};
+
+class SYNTH {
+public:
+  SYNTH(EMIT emit, void *ctx) : emit(emit), ctx(ctx) {}
+  virtual ~SYNTH() {}
+  virtual const char *name() const = 0;
+  // msg is a complete 3 byte control change
+  void onCC(const unsigned char *msg) { control(msg[0], msg[1], msg[2], 127); }
+  // The same CC at any resolution: value runs 0..range instead of 0..127
+  virtual void control(unsigned char status, int cc, int value, int range) = 0;
+  virtual void updateAlgos(int algo) = 0;
+  // Send the whole voice image as the synth's bulk dump format
+  virtual void sendVoice() = 0;
+  // Take a bulk dump in this synth's format into the voice image.
+  // False if the message is not one (or fails its checksum).
+  virtual bool loadVoice(const unsigned char *message, size_t size) = 0;
+  // Mirror every parameter sent into the shared state segment (or stop
+  // with 0). Called with ENGINE_MUTEX held, like everything above.
+  virtual void setMirror(STATE_PORT *state) = 0;
+
+protected:
+  EMIT emit;
+  void *ctx;
+  STATE_PORT *mirror = 0;
+};
+
+// Known profile names are "tx81z" and "dx7". Returns 0 for anything else.
+SYNTH *makeSynth(const std::string &profile, EMIT emit, void *ctx);
+
+template <class P> class SYNTH_ENGINE : public SYNTH {
+public:
+  SYNTH_ENGINE(EMIT emit, void *ctx) : SYNTH(emit, ctx) {
+    for (int i = 0; i < 128; i++) lastSent[i] = -1;
+    for (int i = 0; i < P::VOICE_SIZE; i++) voice[i] = 0;
+    updateAlgos(0);
+  }
+  const char *name() const { return P::NAME; }
+
+  void control(unsigned char status, int mCC, int value, int range) {
+    if (mCC < 0 || mCC > 127) return;
+    if (range < 1) range = 127;
+    if (value < 0) value = 0;
+    if (value > range) value = range;
+    const CC_MAPPING &C = P::MAP[mCC];
+
+    switch (C.TYPE) {
+      // --- 2A. FIXED CC / SYSTEM Logic (The 3.7 Freeze Fix) ---
+      case CC:
+      case SYSTEM: {
+        int rawIn = range == 127 ? value : (value * 127 + range / 2) / range;
+
+        // Deduplicate to prevent flooding
+        if (rawIn == lastSent[mCC]) return;
+        lastSent[mCC] = rawIn;
+
+        // Own buffer, decoupled from the input message.
+        unsigned char oCC[3] = { status, (unsigned char)C.CC,
+                                 (unsigned char)rawIn }; // keep original channel
+        emit(ctx, oCC, 3);
+        return;
+      }
+
+      // --- 2B. SYSEX Logic ---
+      case SYSEX: {
+        int tMin = C.MIN;
+        int tMax = C.MAX;
+        int tRange = tMax - tMin;
+        int finalVal = tMin;
+
+        if (tRange > 0) {
+          finalVal = tMin + ((value * tRange) + range / 2) / range;
+        }
+
+        if (finalVal == lastSent[mCC]) {
+          return;
+        }
+        lastSent[mCC] = finalVal;
+
+        if (finalVal > tMax) finalVal = tMax;
+        if (finalVal < tMin) finalVal = tMin;
+
+        sendParam(C.GROUP, C.PARAMETER, finalVal);
+        return;
+      }
+
+      // --- 2C. MACRO Logic ---
+      case MACRO: {
+        int finalVal = (value * (C.MAX - C.MIN) + range / 2) / range + C.MIN;
+
+        updateAlgos(finalVal);
+
+        const ENVS *ENV = &ATTACK;
+        switch (C.PARAMETER) {
+          case 0: ENV = &ATTACK; break;
+          case 1: ENV = &DECAY; break;
+          case 2: ENV = &SUSTAIN; break;
+          case 3: ENV = &RELEASE; break;
+        }
+        const std::vector<int>& params = (C.GROUP == 0) ? ENV->CARRIERS :
+                                         (C.GROUP == 1) ? ENV->MODULATORS :
+                                         (C.GROUP == 2) ? ENV->LCARRIERS : ENV->LMODULATORS;
+        for (size_t i = 0; i != params.size(); i++)
+          control(status, params.at(i), value, range);
+        return;
+      }
+
+      case SKIP:
+        return;
+    }
+  }
+
+  void updateAlgos(int algo) {
+    if (algo < 0 || algo >= P::ALGO_COUNT) algo = 0;
+    ENVS *E[4] = { &ATTACK, &DECAY, &SUSTAIN, &RELEASE };
+    for (int k = 0; k < 4; k++) {
+      E[k]->CARRIERS.clear();
+      E[k]->LCARRIERS.clear();
+      E[k]->MODULATORS.clear();
+      E[k]->LMODULATORS.clear();
+    }
+
+    // Bit (op - 1) of the algorithm entry is set when op is a carrier
+    for (int op = 1; op <= P::OPS; op++) {
+      int base = P::opCC(op);
+      bool carrier = (P::ALGOS[algo] & (1 << (op - 1))) != 0;
+      for (int k = 0; k < 4; k++) {
+        (carrier ? E[k]->CARRIERS : E[k]->MODULATORS).push_back(base + P::EG_RATE[k]);
+        (carrier ? E[k]->LCARRIERS : E[k]->LMODULATORS).push_back(base + P::EG_LEVEL[k]);
+      }
+    }
+  }
+
+  void sendVoice() { P::bulk(voice, emit, ctx); }
+  bool loadVoice(const unsigned char *message, size_t size) {
+    if (!P::unbulk(voice, message, size)) return false;
+    if (mirror) stateImage(mirror, P::NAME, voice, P::VOICE_SIZE, true);
+    return true;
+  }
+  void setMirror(STATE_PORT *state) {
+    mirror = state;
+    if (mirror) stateImage(mirror, P::NAME, voice, P::VOICE_SIZE, false);
+  }
+
+protected:
+  void sendParam(int group, int parameter, int value) {
+    unsigned char oSYX[8];
+    int s = P::slot(group, parameter);
+    voice[s] = (unsigned char)value;
+    if (mirror) stateVoice(mirror, s, (unsigned char)value);
+    emit(ctx, oSYX, P::frame(oSYX, group, parameter, value));
+  }
+
+  int lastSent[128];
+  unsigned char voice[P::VOICE_SIZE];
+  ENVS ATTACK, DECAY, SUSTAIN, RELEASE;
+};
+
+#endif
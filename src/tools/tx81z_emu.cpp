@@ -0,0 +1,349 @@
+/*******************************************************************
+tx81z_emu: a stand-in TX81Z for tuning txsex's output pacing without
+the hardware.
+
+Opens an ALSA input (a virtual port "TX81Z EMU" unless -i names one to
+read from) and plays the synth's side of a DIN cable:
+
+  wire     bytes arrive one per 320us (31250 baud), whatever rate ALSA
+           hands them over at; a USB interface queues the rest.
+  buffer   the synth's receive buffer, -buffer bytes. A byte landing in
+           a full buffer is lost (the "MIDI Buffer Full" message) and
+           takes the message it belongs to with it.
+  parser   one message at a time once it is complete, -notecost,
+           -paramcost or -bulkcost microseconds each. A message leaves
+           the buffer when it has been processed.
+
+Parameter changes (VCED and ACED) and single voice bulk dumps are
+applied to a voice image. With -state it maps txsex's state segment (see
+state.h) and at the end compares that image with the voice txsex meant
+to send, slot by slot for every slot txsex has sent.
+
+  tx81z_emu [-i port] [-state /name [-port n]] [-buffer bytes]
+            [-notecost us] [-paramcost us] [-bulkcost us] [-idle s]
+
+Stops on Ctrl-C, or -idle seconds after the last message. Prints a
+report and exits 0 only when nothing was lost and the voices match.
+
+The default buffer size and costs are estimates that make sustained
+parameter changes at the full wire rate overflow, as the hardware does;
+adjust them to what a real unit shows.
+*****************************************************************/
+#include "../RtMidi.h"
+#include "../profiles.h"
+#include "../state.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+using namespace std;
+
+const long long WIRE_US_PER_BYTE = 320; // 10 bits at 31250 baud
+const long long NEVER = LLONG_MAX;
+
+int BUFFER = 128;          // bytes
+long long NOTE_COST = 100; // us per channel message
+long long PARAM_COST = 2500;
+long long BULK_COST = 60000;
+
+volatile sig_atomic_t stopRequested = 0;
+void signalHandler(int /*signum*/) { stopRequested = 1; }
+
+long long getMicros() {
+  return chrono::duration_cast<chrono::microseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct MESSAGE {
+  vector<unsigned char> bytes;
+  long long arrived = 0; // from ALSA
+  int held = 0;          // bytes that made it into the buffer
+  bool corrupt = false;  // lost a byte to a full buffer
+};
+
+// The model. Everything happens in advance(), in time order, on whichever
+// thread calls it with the lock held.
+struct EMULATOR {
+  std::mutex lock;
+  deque<MESSAGE> wire;   // front is on the wire, wirePos bytes sent
+  size_t wirePos = 0;
+  long long nextByte = NEVER;
+  deque<MESSAGE> buffer; // landed, front is parsed first
+  int buffered = 0;      // bytes in the buffer
+  long long parsedAt = NEVER; // when the front of the buffer is done
+
+  unsigned char voice[TX81Z::VOICE_SIZE];
+  bool touched[TX81Z::VOICE_SIZE];
+
+  unsigned long messages = 0, bytes = 0, notes = 0, params = 0, bulks = 0,
+                other = 0, overruns = 0, lostEdits = 0, lostNotes = 0;
+  int maxBuffered = 0;
+  long long maxLatency = 0, totalLatency = 0, lastArrival = 0;
+
+  EMULATOR() {
+    memset(voice, 0, sizeof(voice));
+    memset(touched, 0, sizeof(touched));
+  }
+
+  void receive(long long now, const vector<unsigned char> &message) {
+    advance(now);
+    if (message.empty()) return;
+    MESSAGE M;
+    M.bytes = message;
+    M.arrived = now;
+    wire.push_back(M);
+    if (wire.size() == 1) nextByte = now + WIRE_US_PER_BYTE;
+    messages++;
+    bytes += message.size();
+    lastArrival = now;
+  }
+
+  void advance(long long until) {
+    while (true) {
+      long long t = min(nextByte, parsedAt);
+      if (t > until) return;
+      if (t == nextByte) land(t);
+      else parsed(t);
+    }
+  }
+
+  // The next wire byte reaches the synth at t.
+  void land(long long t) {
+    MESSAGE &M = wire.front();
+    if (wirePos == 0) buffer.push_back(MESSAGE()); // starts landing
+    MESSAGE &B = buffer.back();
+    if (buffered < BUFFER) {
+      buffered++;
+      B.held++;
+      maxBuffered = max(maxBuffered, buffered);
+    } else {
+      overruns++;
+      B.corrupt = true;
+    }
+    if (++wirePos < M.bytes.size()) {
+      nextByte = t + WIRE_US_PER_BYTE;
+      return;
+    }
+    // Complete: hand it to the parser side
+    B.bytes.swap(M.bytes);
+    B.arrived = M.arrived;
+    wire.pop_front();
+    wirePos = 0;
+    nextByte = wire.empty() ? NEVER : max(t, wire.front().arrived) + WIRE_US_PER_BYTE;
+    startParse(t);
+  }
+
+  // The parser is done with the front of the buffer at t.
+  void parsed(long long t) {
+    MESSAGE &M = buffer.front();
+    apply(M, t);
+    buffered -= M.held;
+    buffer.pop_front();
+    parsedAt = NEVER;
+    startParse(t);
+  }
+
+  // The parser takes the front message once all of it has landed.
+  void startParse(long long t) {
+    if (parsedAt != NEVER || buffer.empty()) return;
+    if (buffer.size() == 1 && wirePos > 0) return; // still landing
+    parsedAt = t + cost(buffer.front());
+  }
+
+  long long cost(const MESSAGE &M) {
+    if (M.bytes[0] != 0xF0) return NOTE_COST;
+    return M.bytes.size() <= 7 ? PARAM_COST : BULK_COST;
+  }
+
+  void apply(const MESSAGE &M, long long t) {
+    const vector<unsigned char> &m = M.bytes;
+    bool edit = m[0] == 0xF0;
+    if (M.corrupt) {
+      if (edit) lostEdits++;
+      else lostNotes++;
+      return;
+    }
+    long long latency = t - M.arrived;
+    maxLatency = max(maxLatency, latency);
+    totalLatency += latency;
+    if (!edit) {
+      notes++;
+      return;
+    }
+    // F0 43 1n gg pp dd F7, VCED is group 0x12, ACED 0x13
+    if (m.size() == 7 && m[1] == 0x43 && (m[2] & 0xF0) == 0x10 &&
+        (m[3] == 0x12 || m[3] == 0x13)) {
+      int slot = TX81Z::slot(m[3], m[4]);
+      if (slot < TX81Z::VOICE_SIZE) {
+        voice[slot] = m[5];
+        touched[slot] = true;
+        params++;
+        return;
+      }
+    }
+    if (TX81Z::unbulk(voice, m.data(), m.size())) {
+      // Whichever half it was, it now holds what the dump said
+      bool aced = m.size() > 5 && m[3] == 0x7E;
+      for (int i = aced ? 94 : 0; i < (aced ? TX81Z::VOICE_SIZE : 93); i++)
+        touched[i] = true;
+      bulks++;
+      return;
+    }
+    other++;
+  }
+};
+
+// Maps txsex's state segment read only. Stays mapped after txsex exits,
+// so the intended voice can still be read then.
+static const STATE_SEGMENT *mapState(const string &name) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) return 0;
+  void *mem = mmap(0, sizeof(STATE_SEGMENT), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) return 0;
+  const STATE_SEGMENT *S = static_cast<const STATE_SEGMENT *>(mem);
+  if (S->magic != STATE_MAGIC) {
+    munmap(mem, sizeof(STATE_SEGMENT));
+    return 0;
+  }
+  return S;
+}
+
+static string slotName(int slot) {
+  return slot >= 94 ? "ACED " + to_string(slot - 94) : "VCED " + to_string(slot);
+}
+
+// Slots txsex has sent and the emulator did not end up with. -1 when
+// there is nothing to compare with.
+static int compare(const STATE_SEGMENT *S, int port, EMULATOR &E) {
+  if (!S || port >= (int)S->ports) return -1;
+  STATE_VOICE V;
+  stateRead(S->port[port].voiceSeq, S->port[port].voice, V);
+  if (string(V.profile) != TX81Z::NAME) {
+    cout << "tx81z_emu => txsex port " << port << " uses the " << V.profile
+         << " profile, not tx81z" << endl;
+    return -1;
+  }
+  int bad = 0, sent = 0;
+  for (int i = 0; i < TX81Z::VOICE_SIZE && i < (int)V.size; i++) {
+    if (!V.stamp[i]) continue;
+    sent++;
+    if (E.touched[i] && E.voice[i] == V.data[i]) continue;
+    if (bad++ < 20)
+      cout << "tx81z_emu => " << slotName(i) << ": txsex sent "
+           << (int)V.data[i] << ", synth has "
+           << (E.touched[i] ? to_string(E.voice[i]) : string("nothing")) << endl;
+  }
+  cout << "tx81z_emu => Voice check: " << sent - bad << " of " << sent
+       << " sent parameters match" << endl;
+  return bad;
+}
+
+EMULATOR EMU;
+
+void onInput(double /*deltatime*/, std::vector<unsigned char> *message,
+             void * /*userData*/) {
+  std::lock_guard<std::mutex> lk(EMU.lock);
+  EMU.receive(getMicros(), *message);
+}
+
+int main(int argc, char *argv[]) {
+  string inPort, stateName;
+  int statePortIndex = 0;
+  double idle = 0;
+  for (int i = 1; i < argc; i++) {
+    string cmd(argv[i]);
+    bool more = i + 1 < argc;
+    if (cmd == "-i" && more) inPort = argv[++i];
+    else if (cmd == "-state" && more) stateName = argv[++i];
+    else if (cmd == "-port" && more) statePortIndex = atoi(argv[++i]);
+    else if (cmd == "-buffer" && more) BUFFER = max(1, atoi(argv[++i]));
+    else if (cmd == "-notecost" && more) NOTE_COST = max(0L, atol(argv[++i]));
+    else if (cmd == "-paramcost" && more) PARAM_COST = max(0L, atol(argv[++i]));
+    else if (cmd == "-bulkcost" && more) BULK_COST = max(0L, atol(argv[++i]));
+    else if (cmd == "-idle" && more) idle = atof(argv[++i]);
+    else {
+      cout << "Usage: tx81z_emu [-i port] [-state /name [-port n]] "
+              "[-buffer bytes]\n"
+              "       [-notecost us] [-paramcost us] [-bulkcost us] [-idle s]"
+           << endl;
+      return 2;
+    }
+  }
+  signal(SIGINT, signalHandler);
+  signal(SIGTERM, signalHandler);
+
+  RtMidiIn *in = new RtMidiIn();
+  in->setCallback(&onInput, 0);
+  in->ignoreTypes(false, true, true); // sysex yes, clock and sensing no
+  if (inPort.empty()) {
+    in->openVirtualPort("TX81Z EMU");
+    cout << "tx81z_emu => Listening on virtual port: TX81Z EMU" << endl;
+  } else {
+    int id = -1;
+    for (unsigned int i = 0; i < in->getPortCount(); i++)
+      if (in->getPortName(i).find(inPort) != string::npos) id = i;
+    if (id == -1) {
+      cout << "tx81z_emu => No input port matches " << inPort << endl;
+      return 2;
+    }
+    in->openPort(id, "TX81Z EMU");
+    cout << "tx81z_emu => Reading from: " << in->getPortName(id) << endl;
+  }
+  cout << "tx81z_emu => Buffer " << BUFFER << " bytes, costs note "
+       << NOTE_COST << "us, param " << PARAM_COST << "us, bulk " << BULK_COST
+       << "us" << endl;
+
+  const STATE_SEGMENT *state = 0;
+  while (!stopRequested) {
+    usleep(10000);
+    long long now = getMicros();
+    std::lock_guard<std::mutex> lk(EMU.lock);
+    EMU.advance(now);
+    // txsex is running once something arrives, so its segment is there
+    if (!state && !stateName.empty() && EMU.messages) state = mapState(stateName);
+    if (idle > 0 && EMU.messages && now - EMU.lastArrival > idle * 1000000)
+      break;
+  }
+  in->closePort();
+  delete in;
+
+  // Let the model finish whatever it still holds
+  std::lock_guard<std::mutex> lk(EMU.lock);
+  EMU.advance(NEVER - 1);
+  unsigned long applied = EMU.notes + EMU.params + EMU.bulks + EMU.other;
+  cout << "tx81z_emu => Received " << EMU.messages << " messages ("
+       << EMU.bytes << " bytes): " << EMU.params << " parameter changes, "
+       << EMU.bulks << " bulk dumps, " << EMU.notes << " channel, "
+       << EMU.other << " other" << endl;
+  cout << "tx81z_emu => Buffer peak " << EMU.maxBuffered << "/" << BUFFER
+       << " bytes, overruns " << EMU.overruns << " bytes, lost edits "
+       << EMU.lostEdits << ", lost notes " << EMU.lostNotes << endl;
+  if (applied)
+    cout << "tx81z_emu => Arrival to applied: mean "
+         << EMU.totalLatency / (long long)applied / 1000 << "ms, max "
+         << EMU.maxLatency / 1000 << "ms" << endl;
+
+  int mismatches = -1;
+  if (!stateName.empty()) {
+    if (!state) state = mapState(stateName);
+    mismatches = compare(state, statePortIndex, EMU);
+    if (mismatches < 0)
+      cout << "tx81z_emu => Could not read txsex state from " << stateName
+           << endl;
+  }
+  bool ok = EMU.overruns == 0 && EMU.lostEdits == 0 && EMU.lostNotes == 0 &&
+            mismatches <= 0;
+  return ok ? 0 : 1;
+}
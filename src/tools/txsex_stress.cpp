@@ -0,0 +1,357 @@
+/*******************************************************************
+txsex_stress: sustained load on a running txsex.
+
+Sweeps knobs across the operator CC block (CC 67-118, OP4 to OP1 on the
+TX81Z map) all at once, with dense notes on top, into txsex's TXCC, and
+listens on its TXSYX. Every input is stamped when sent. txsex only ever
+drops a CC that would repeat the value it last sent, so the harness
+works out which inputs must come out and in what order, and pairs each
+output with its input:
+
+  latency   send to receive, per message; -late ms counts as late
+  rate      output messages per second
+  dedup     inputs txsex rightly kept back
+  dropped   inputs that should have come out and did not
+  strays    outputs that match no input
+  cpu       txsex's CPU time (all threads) per input event, from /proc
+
+  txsex_stress [-knobs n] [-hz rate] [-notes rate] [-seconds s]
+               [-late ms] [-to port] [-from port] [-pid pid] [-json file]
+
+-knobs 52 (the default) sweeps every CC of the block, each -hz times a
+second. -notes sets note messages per second (ons and offs). Run txsex
+with -rate 0 on its output to measure the translator rather than the DIN
+pacing. Results print as a table and as JSON (to stdout or -json), and
+the exit status is 1 if anything was dropped.
+*****************************************************************/
+#include "../RtMidi.h"
+#include "../profiles.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+using namespace std;
+
+const int BLOCK_FIRST = 67, BLOCK_LAST = 118;
+
+volatile sig_atomic_t stopRequested = 0;
+void signalHandler(int /*signum*/) { stopRequested = 1; }
+
+long long getMicros() {
+  return chrono::duration_cast<chrono::microseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct PENDING {
+  long long sent;
+  int value;     // what txsex should send for it
+  bool optional; // a CC's first value may repeat what txsex last sent
+};
+
+// Guarded by LOCK: the sender adds, the input callback takes.
+std::mutex LOCK;
+deque<PENDING> expectCC[128]; // by CC, in order
+int lastExpected[128];
+map<int, int> paramToCC;                  // group << 7 | parameter
+map<int, deque<long long>> expectNotes;   // status << 16 | note << 8 | vel
+unsigned long sentCC = 0, sentNotes = 0, dedup = 0, received = 0, matched = 0,
+              dropped = 0, late = 0, strays = 0;
+long long lateUs = 10000, latencySum = 0, latencyMax = 0;
+long long firstOut = 0, lastOut = 0;
+vector<long long> latencies;
+
+// What txsex sends for CC value v, as SYNTH_ENGINE::control() works it out
+static int expected(int cc, int value) {
+  const CC_MAPPING &C = TX81Z::MAP[cc];
+  int range = C.MAX - C.MIN;
+  return range > 0 ? C.MIN + (value * range + 63) / 127 : C.MIN;
+}
+
+static void account(long long sent, long long now) {
+  long long latency = now - sent;
+  matched++;
+  latencySum += latency;
+  latencyMax = max(latencyMax, latency);
+  latencies.push_back(latency);
+  if (latency > lateUs) late++;
+}
+
+void onInput(double /*deltatime*/, std::vector<unsigned char> *message,
+             void * /*userData*/) {
+  long long now = getMicros();
+  const vector<unsigned char> &m = *message;
+  if (m.empty()) return;
+  std::lock_guard<std::mutex> lk(LOCK);
+  received++;
+  if (!firstOut) firstOut = now;
+  lastOut = now;
+  if (m.size() == 7 && m[0] == 0xF0 && m[1] == 0x43) {
+    map<int, int>::iterator it = paramToCC.find(m[3] << 7 | m[4]);
+    if (it == paramToCC.end()) {
+      strays++;
+      return;
+    }
+    // Anything queued ahead of the value that came out never will
+    deque<PENDING> &Q = expectCC[it->second];
+    while (!Q.empty() && Q.front().value != m[5]) {
+      if (!Q.front().optional) dropped++;
+      Q.pop_front();
+    }
+    if (Q.empty()) {
+      strays++;
+      return;
+    }
+    account(Q.front().sent, now);
+    Q.pop_front();
+    return;
+  }
+  if (m.size() == 3 && (m[0] & 0xE0) == 0x80) {
+    map<int, deque<long long>>::iterator it =
+        expectNotes.find(m[0] << 16 | m[1] << 8 | m[2]);
+    if (it == expectNotes.end() || it->second.empty()) {
+      strays++;
+      return;
+    }
+    account(it->second.front(), now);
+    it->second.pop_front();
+    return;
+  }
+  strays++;
+}
+
+// Sum of on-CPU time of all of pid's threads, in microseconds; -1 if unknown
+static long long cpuMicros(int pid) {
+  if (pid <= 0) return -1;
+  string dir = "/proc/" + to_string(pid) + "/task";
+  DIR *d = opendir(dir.c_str());
+  if (!d) return -1;
+  long long total = 0;
+  while (struct dirent *e = readdir(d)) {
+    if (e->d_name[0] == '.') continue;
+    ifstream in((dir + "/" + e->d_name + "/schedstat").c_str());
+    long long ns = 0;
+    if (in >> ns) total += ns;
+  }
+  closedir(d);
+  return total / 1000;
+}
+
+static int findTxsex() {
+  DIR *d = opendir("/proc");
+  if (!d) return -1;
+  int pid = -1;
+  while (struct dirent *e = readdir(d)) {
+    if (e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+    ifstream in((string("/proc/") + e->d_name + "/comm").c_str());
+    string comm;
+    if (getline(in, comm) && comm == "txsex") pid = atoi(e->d_name);
+  }
+  closedir(d);
+  return pid;
+}
+
+static int findPort(RtMidi *midi, bool output, const string &name) {
+  unsigned int n = output ? static_cast<RtMidiOut *>(midi)->getPortCount()
+                          : static_cast<RtMidiIn *>(midi)->getPortCount();
+  for (unsigned int i = 0; i < n; i++) {
+    string port = output ? static_cast<RtMidiOut *>(midi)->getPortName(i)
+                         : static_cast<RtMidiIn *>(midi)->getPortName(i);
+    if (port.find(name) != string::npos) return i;
+  }
+  return -1;
+}
+
+struct STREAM {
+  long long period, next; // us
+  int cc;                 // -1 for the note stream
+  unsigned long step = 0;
+};
+
+int main(int argc, char *argv[]) {
+  int knobs = BLOCK_LAST - BLOCK_FIRST + 1, pid = -1;
+  double hz = 20, noteRate = 50, seconds = 10;
+  string to = "TXCC", from = "TXSYX", jsonPath;
+  for (int i = 1; i < argc; i++) {
+    string cmd(argv[i]);
+    bool more = i + 1 < argc;
+    if (cmd == "-knobs" && more) knobs = atoi(argv[++i]);
+    else if (cmd == "-hz" && more) hz = atof(argv[++i]);
+    else if (cmd == "-notes" && more) noteRate = atof(argv[++i]);
+    else if (cmd == "-seconds" && more) seconds = atof(argv[++i]);
+    else if (cmd == "-late" && more) lateUs = (long long)(atof(argv[++i]) * 1000);
+    else if (cmd == "-to" && more) to = argv[++i];
+    else if (cmd == "-from" && more) from = argv[++i];
+    else if (cmd == "-pid" && more) pid = atoi(argv[++i]);
+    else if (cmd == "-json" && more) jsonPath = argv[++i];
+    else {
+      cout << "Usage: txsex_stress [-knobs n] [-hz rate] [-notes rate] "
+              "[-seconds s]\n"
+              "                    [-late ms] [-to port] [-from port] [-pid "
+              "pid] [-json file]"
+           << endl;
+      return 2;
+    }
+  }
+  knobs = max(0, min(knobs, BLOCK_LAST - BLOCK_FIRST + 1));
+  signal(SIGINT, signalHandler);
+
+  for (int cc = BLOCK_FIRST; cc <= BLOCK_LAST; cc++)
+    paramToCC[TX81Z::MAP[cc].GROUP << 7 | TX81Z::MAP[cc].PARAMETER] = cc;
+  for (int cc = 0; cc < 128; cc++) lastExpected[cc] = -1;
+
+  RtMidiOut *out = new RtMidiOut();
+  RtMidiIn *in = new RtMidiIn(RtMidi::UNSPECIFIED, "txsex_stress", 4096);
+  int outId = findPort(out, true, to), inId = findPort(in, false, from);
+  if (outId < 0 || inId < 0) {
+    cout << "txsex_stress => Can not find " << (outId < 0 ? to : from)
+         << ", is txsex running?" << endl;
+    return 2;
+  }
+  in->setCallback(&onInput, 0);
+  in->ignoreTypes(false, true, true);
+  in->openPort(inId, "stress in");
+  out->openPort(outId, "stress out");
+  if (pid <= 0) pid = findTxsex();
+  if (pid <= 0) cout << "txsex_stress => txsex not found, no CPU figures" << endl;
+
+  // Knobs spread evenly over the block, staggered within their period
+  vector<STREAM> streams;
+  long long start = getMicros() + 100000;
+  for (int k = 0; k < knobs && hz > 0; k++) {
+    STREAM S;
+    S.cc = BLOCK_FIRST + k * (BLOCK_LAST - BLOCK_FIRST + 1) / knobs;
+    S.period = (long long)(1000000 / hz);
+    S.next = start + S.period * k / knobs;
+    S.step = k * 16; // not all in step
+    streams.push_back(S);
+  }
+  if (noteRate > 0) {
+    STREAM S;
+    S.cc = -1;
+    S.period = (long long)(1000000 / noteRate);
+    S.next = start;
+    streams.push_back(S);
+  }
+  if (streams.empty()) return 2;
+  cout << "txsex_stress => " << knobs << " knobs at " << hz << "Hz, "
+       << noteRate << " notes/s for " << seconds << "s" << endl;
+
+  long long cpuBefore = cpuMicros(pid);
+  long long end = start + (long long)(seconds * 1000000);
+  unsigned char msg[3];
+  while (!stopRequested) {
+    STREAM *S = &streams[0];
+    for (size_t i = 1; i < streams.size(); i++)
+      if (streams[i].next < S->next) S = &streams[i];
+    if (S->next >= end) break;
+    long long wait = S->next - getMicros();
+    if (wait > 0) std::this_thread::sleep_for(chrono::microseconds(wait));
+
+    if (S->cc >= 0) { // triangle sweep, one step per message
+      int phase = S->step % 254;
+      msg[0] = 0xB0;
+      msg[1] = S->cc;
+      msg[2] = phase < 127 ? phase : 254 - phase;
+    } else { // ons and offs, a different note and velocity each time
+      int n = S->step / 2;
+      msg[0] = S->step % 2 ? 0x80 : 0x90;
+      msg[1] = 36 + n % 60;
+      msg[2] = 1 + (n / 60) % 127;
+    }
+    {
+      std::lock_guard<std::mutex> lk(LOCK);
+      long long now = getMicros();
+      if (S->cc >= 0) {
+        sentCC++;
+        int v = expected(S->cc, msg[2]);
+        if (v == lastExpected[S->cc]) {
+          dedup++;
+        } else {
+          PENDING P = { now, v, lastExpected[S->cc] == -1 };
+          lastExpected[S->cc] = v;
+          expectCC[S->cc].push_back(P);
+        }
+      } else {
+        sentNotes++;
+        expectNotes[msg[0] << 16 | msg[1] << 8 | msg[2]].push_back(now);
+      }
+    }
+    out->sendMessage(msg, 3);
+    S->step++;
+    S->next += S->period;
+  }
+  long long sendEnd = getMicros();
+
+  // Give txsex a second to deliver the tail, longer if it is still busy
+  unsigned long seen = ~0UL;
+  while (!stopRequested) {
+    usleep(1000000);
+    std::lock_guard<std::mutex> lk(LOCK);
+    if (received == seen) break;
+    seen = received;
+  }
+  long long cpuAfter = cpuMicros(pid);
+  in->closePort();
+  out->closePort();
+
+  std::lock_guard<std::mutex> lk(LOCK);
+  for (int cc = 0; cc < 128; cc++)
+    for (size_t i = 0; i < expectCC[cc].size(); i++)
+      if (!expectCC[cc][i].optional) dropped++;
+  for (map<int, deque<long long>>::iterator it = expectNotes.begin();
+       it != expectNotes.end(); it++)
+    dropped += it->second.size();
+  sort(latencies.begin(), latencies.end());
+  unsigned long sent = sentCC + sentNotes;
+  double p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2] / 1000.0;
+  double p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100] / 1000.0;
+  double outRate = lastOut > firstOut ? received * 1e6 / (lastOut - firstOut) : 0;
+  double inRate = sent * 1e6 / max(1LL, sendEnd - start);
+  double cpu = cpuBefore >= 0 && cpuAfter >= 0 && sent
+                   ? (cpuAfter - cpuBefore) * 1000.0 / sent
+                   : -1;
+
+  printf("sent        %lu (%lu CC, %lu notes), %.0f/s\n", sent, sentCC,
+         sentNotes, inRate);
+  printf("received    %lu, %.0f/s\n", received, outRate);
+  printf("dedup       %lu (%.1f%% of CC)\n", dedup,
+         sentCC ? dedup * 100.0 / sentCC : 0.0);
+  printf("dropped     %lu\nstrays      %lu\n", dropped, strays);
+  printf("latency     p50 %.2fms, p99 %.2fms, max %.2fms, late %lu (> %lldms)\n",
+         p50, p99, latencyMax / 1000.0, late, lateUs / 1000);
+  if (cpu >= 0) printf("cpu         %.0fns per event\n", cpu);
+
+  ostringstream json;
+  json << "{\"knobs\":" << knobs << ",\"hz\":" << hz << ",\"notes\":" << noteRate
+       << ",\"seconds\":" << seconds << ",\"sent\":" << sent
+       << ",\"sent_cc\":" << sentCC << ",\"sent_notes\":" << sentNotes
+       << ",\"received\":" << received << ",\"in_per_sec\":" << inRate
+       << ",\"out_per_sec\":" << outRate << ",\"dedup\":" << dedup
+       << ",\"dedup_ratio\":" << (sentCC ? (double)dedup / sentCC : 0)
+       << ",\"dropped\":" << dropped << ",\"strays\":" << strays
+       << ",\"late\":" << late << ",\"latency_p50_ms\":" << p50
+       << ",\"latency_p99_ms\":" << p99
+       << ",\"latency_max_ms\":" << latencyMax / 1000.0
+       << ",\"cpu_ns_per_event\":" << cpu << "}";
+  if (jsonPath.empty()) {
+    cout << json.str() << endl;
+  } else {
+    ofstream f(jsonPath.c_str());
+    f << json.str() << endl;
+  }
+  delete in;
+  delete out;
+  return dropped ? 1 : 0;
+}